@@ -42,6 +42,28 @@ extern NSString * _Nonnull const FCModelChangedFieldsKey;
 //
 extern NSString * _Nonnull const FCModelOldFieldValuesKey;
 //
+// userInfo[FCModelInsertedPrimaryKeyValuesKey], [FCModelUpdatedPrimaryKeyValuesKey], and [FCModelDeletedPrimaryKeyValuesKey]
+//  are NSSets of the primary-key values of rows that were inserted, updated, and deleted, so observers can update
+//  incrementally instead of refetching.
+// Only included in notifications without FCModelInstanceKey (e.g. coalesced transaction notifications, bulk operations,
+//  executeUpdateQuery:, and the update hook), and only if every changed row is known. They're absent after more than
+//  10,000 changed rows for the class, or after writes through SQL to a table whose primary key isn't its rowid (declared
+//  "INTEGER PRIMARY KEY"): then treat the change as unspecified.
+// Changes within one notification are reported by net effect: a row inserted and then updated is only in the inserted set,
+//  one inserted and then deleted isn't listed, and one deleted and then inserted again is in the updated set.
+// Batch deletes may list keys that had no row.
+//
+extern NSString * _Nonnull const FCModelInsertedPrimaryKeyValuesKey;
+extern NSString * _Nonnull const FCModelUpdatedPrimaryKeyValuesKey;
+extern NSString * _Nonnull const FCModelDeletedPrimaryKeyValuesKey;
+//
+// userInfo[FCModelChangedRowIDsKey] is an NSSet of NSNumber SQLite rowids.
+// Only included in notifications for writes that FCModel didn't make itself, such as raw SQL in inDatabaseSync: or
+//  triggers. Those are coalesced into one notification per class on the database queue's next turn. The key is absent
+//  if more than 10,000 rows changed.
+//
+extern NSString * _Nonnull const FCModelChangedRowIDsKey;
+//
 // userInfo[FCModelChangeTypeKey] is an NSNumber from the following enum:
 //
 extern NSString * _Nonnull const FCModelChangeTypeKey;
@@ -52,6 +74,47 @@ typedef NS_ENUM(NSInteger, FCModelChangeType) {
     FCModelChangeTypeUpdate,      // The object in FCModelInstanceKey is non-nil, and was updated in the database
     FCModelChangeTypeDelete       // The object in FCModelInstanceKey is non-nil, and was deleted from the database
 };
+// Notifications without FCModelInstanceKey (e.g. from bulk inserts, batch deletes, or upserts of rows that aren't loaded)
+//  are always Unspecified. The primary-key userInfo keys above list what was inserted, updated, or deleted.
+
+typedef NS_ENUM(NSInteger, FCModelPrimaryKeyGeneration) {
+    FCModelPrimaryKeyGenerationCheckDatabase,
+    FCModelPrimaryKeyGenerationCheckLoadedInstances,
+    FCModelPrimaryKeyGenerationSequential
+};
+
+typedef NS_OPTIONS(NSUInteger, FCModelDatabaseOptions) {
+    FCModelDatabaseOptionsNone          = 0,
+    
+    // By default, all database work is serialized on the main queue, so background threads calling FCModel block on it.
+    // With this option, FCModel instead owns a private serial queue for all SQLite work and identity-map access:
+    //  - Blocks passed to save:, performTransaction:, inDatabaseSync:, etc. are executed on that queue.
+    //  - FCModelChangeNotification is still delivered on the main queue, but asynchronously when the change happens off-main.
+    //  - SwiftUI/Combine objectWillChange is likewise sent asynchronously on the main queue.
+    FCModelDatabaseOptionPrivateQueue   = 1 << 0,
+
+    // Puts the database in WAL mode and adds a pool of read-only connections (one per CPU core, minimum 2).
+    //  SELECTs from threads other than the database queue run on them in parallel, without waiting for the writer.
+    //  Writes (save, delete, executeUpdateQuery, inDatabaseSync, transactions) stay on the single writer connection.
+    // Reads see the most recently committed data, so they won't see another thread's transaction until it commits.
+    FCModelDatabaseOptionConcurrentReaders = 1 << 1,
+};
+
+typedef NS_OPTIONS(NSUInteger, FCModelEnumerationOptions) {
+    FCModelEnumerationOptionsNone = 0,
+    
+    // Rows that aren't already loaded become instances that aren't kept in FCModel's unique-instance map, so they can be
+    //  deallocated as soon as you're done with them. Don't save or delete these unless you're sure no other instance of the
+    //  same row is loaded at the same time.
+    FCModelEnumerationOptionDoNotRegisterInstances = 1 << 0,
+};
+
+typedef NS_OPTIONS(NSUInteger, FCModelPrimaryKeyLookupOptions) {
+    FCModelPrimaryKeyLookupOptionsNone = 0,
+    
+    // Return instances in the order of the supplied keys (by each key's first occurrence), skipping keys without rows
+    FCModelPrimaryKeyLookupOptionPreserveKeyOrder = 1 << 0,
+};
 
 
 @interface FCModel : NSObject
@@ -66,6 +129,7 @@ typedef NS_ENUM(NSInteger, FCModelChangeType) {
 // You can find it in Xcode under Build Settings -> Product Module Name.
 + (void)openDatabaseAtPath:(NSString * _Nonnull)path withDatabaseInitializer:(void (^ _Nullable)(FMDatabase * _Nonnull db))databaseInitializer schemaBuilder:(void (^ _Nonnull)(FMDatabase * _Nonnull db, int * _Nonnull schemaVersion))schemaBuilder;
 + (void)openDatabaseAtPath:(NSString * _Nonnull)path withDatabaseInitializer:(void (^ _Nullable)(FMDatabase * _Nonnull db))databaseInitializer schemaBuilder:(void (^ _Nonnull)(FMDatabase * _Nonnull db, int * _Nonnull schemaVersion))schemaBuilder moduleName:(NSString * _Nullable)moduleName;
++ (void)openDatabaseAtPath:(NSString * _Nonnull)path withDatabaseInitializer:(void (^ _Nullable)(FMDatabase * _Nonnull db))databaseInitializer schemaBuilder:(void (^ _Nonnull)(FMDatabase * _Nonnull db, int * _Nonnull schemaVersion))schemaBuilder moduleName:(NSString * _Nullable)moduleName options:(FCModelDatabaseOptions)options;
 
 + (NSArray * _Nullable)databaseFieldNames;
 + (NSString * _Nullable)primaryKeyFieldName;
@@ -118,16 +182,73 @@ typedef NS_ENUM(NSInteger, FCModelChangeType) {
 + (NSUInteger)numberOfInstancesWhere:(NSString * _Nullable)queryAfterWHERE, ...;
 + (NSUInteger)numberOfInstancesWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments;
 
+// Streaming variants for large result sets: rows are read and passed to the block one at a time, without collecting them
+//  into an array, and autoreleased objects are drained every few hundred rows, so memory use doesn't grow with the result.
+//  Set *stop to YES to end early. The block is called synchronously, from within the database read context.
++ (void)enumerateInstancesWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments usingBlock:(void (^ _Nonnull)(id _Nonnull instance, BOOL * _Nonnull stop))block;
++ (void)enumerateInstancesWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments options:(FCModelEnumerationOptions)options usingBlock:(void (^ _Nonnull)(id _Nonnull instance, BOOL * _Nonnull stop))block;
+
+// Asynchronous variants: the operation runs on FCModel's database execution context (a concurrent reader for SELECTs if
+//  FCModelDatabaseOptionConcurrentReaders is enabled, otherwise the database queue) and never blocks the caller.
+//  The completion block is called on completionQueue, or the main queue if nil or unspecified.
++ (void)instancesWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments completion:(void (^ _Nonnull)(NSArray * _Nullable instances))completion;
++ (void)instancesWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments completionQueue:(dispatch_queue_t _Nullable)completionQueue completion:(void (^ _Nonnull)(NSArray * _Nullable instances))completion;
++ (void)firstInstanceWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments completion:(void (^ _Nonnull)(id _Nullable instance))completion;
++ (void)firstInstanceWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments completionQueue:(dispatch_queue_t _Nullable)completionQueue completion:(void (^ _Nonnull)(id _Nullable instance))completion;
++ (void)numberOfInstancesWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments completion:(void (^ _Nonnull)(NSUInteger count))completion;
++ (void)numberOfInstancesWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments completionQueue:(dispatch_queue_t _Nullable)completionQueue completion:(void (^ _Nonnull)(NSUInteger count))completion;
++ (void)executeUpdateQuery:(NSString * _Nullable)query arguments:(NSArray * _Nullable)args completion:(void (^ _Nullable)(void))completion;
++ (void)executeUpdateQuery:(NSString * _Nullable)query arguments:(NSArray * _Nullable)args completionQueue:(dispatch_queue_t _Nullable)completionQueue completion:(void (^ _Nullable)(void))completion;
+
 // Batch-operate on instances matching a set of primary keys, i.e. "WHERE key IN (...)"
 // Note: "ORDER BY" clauses should not be included in the andWhere strings, since these may execute multiple queries and ordering may not be consistent
+//
+// Lookups and counts with more keys than fit in one query's parameters send all of the keys as a single JSON array,
+//  joined through SQLite's json_each(), in one statement. If SQLite lacks the JSON functions or a key isn't
+//  JSON-encodable, they fall back to multiple IN (...) queries.
+//
 + (NSArray * _Nullable)instancesWithPrimaryKeyValues:(NSArray * _Nullable)primaryKeyValues;
 + (NSArray * _Nullable)instancesWherePrimaryKeyValueIn:(NSArray * _Nullable)primaryKeyValues andWhere:(NSString * _Nullable)additionalWhereClause arguments:(NSArray * _Nullable)additionalWhereArguments;
++ (NSArray * _Nullable)instancesWherePrimaryKeyValueIn:(NSArray * _Nullable)primaryKeyValues andWhere:(NSString * _Nullable)additionalWhereClause arguments:(NSArray * _Nullable)additionalWhereArguments options:(FCModelPrimaryKeyLookupOptions)options;
 + (NSUInteger)numberOfInstancesWherePrimaryKeyValueIn:(NSArray * _Nullable)primaryKeyValues andWhere:(NSString * _Nullable)additionalWhereClause arguments:(NSArray * _Nullable)additionalWhereArguments;
 + (void)executeUpdateQuerySet:(NSString * _Nonnull)setClause setArguments:(NSArray * _Nonnull)setArguments wherePrimaryKeyValueIn:(NSArray * _Nullable)primaryKeyValues andWhere:(NSString * _Nullable)additionalWhereClause arguments:(NSArray * _Nullable)additionalWhereArguments;
 
+// Bulk insert: saves many new (never-saved) instances of the called class in one transaction, reusing one prepared
+//  INSERT, and posts one change notification for the class (with no FCModelInstanceKey) instead of one per instance.
+//  - insertInstances: raises an exception if any instance isn't a new instance of the called class, or if a different
+//      instance with one of their primary keys is already loaded. Returns YES on success.
+//  - insertInstancesWithFieldValues: creates the instances from dictionaries of field values and returns them, or nil on
+//      failure. Rows without a primary-key value get one from primaryKeyValueForNewInstance.
+//  The inserted instances are registered as loaded instances, as if each had been saved. If any row violates a
+//      constraint (e.g. a supplied primary key that already exists), nothing is inserted and NO or nil is returned.
+//
++ (BOOL)insertInstances:(NSArray * _Nonnull)instances;
++ (NSArray * _Nullable)insertInstancesWithFieldValues:(NSArray<NSDictionary *> * _Nonnull)fieldValueDictionaries;
+
+// Upsert: writes rows by primary key with one INSERT ... ON CONFLICT DO UPDATE each, without reading them first.
+//  - Each dictionary must contain the primary-key value. On insert, omitted fields get their column defaults; on update,
+//      only the fields present are written.
+//  - Loaded instances of those rows get the written values (keeping unsaved changes to other fields), and an unsaved
+//      instance created by instanceWithPrimaryKey: is reloaded from its new row.
+//  - A single upsert of a loaded instance posts an Insert or Update notification for it. Otherwise, including for any
+//      batch (which runs in one transaction), one Unspecified notification is posted for the class.
+//  Returns YES on success. Requires SQLite 3.24 or later.
+//
++ (BOOL)upsertWithFieldValues:(NSDictionary * _Nonnull)fieldValues;
++ (BOOL)upsertWithFieldValueDictionaries:(NSArray<NSDictionary *> * _Nonnull)fieldValueDictionaries;
+
+// Batch delete: deletes rows by primary key with as few DELETE ... IN (...) statements as the parameter limit allows,
+//  in one transaction. Loaded instances of those rows are marked deleted and unregistered, and one Delete notification
+//  is posted for the class with the keys in FCModelDeletedPrimaryKeyValuesKey (if any rows were deleted).
+//  deleteInstances: raises an exception if any instance isn't of the called class, and skips unsaved or deleted ones.
+//
++ (void)deleteInstances:(NSArray * _Nonnull)instances;
++ (void)deleteInstancesWithPrimaryKeyValues:(NSArray * _Nonnull)primaryKeyValues;
+
 // Return data instead of completed objects (convenient accessors to FCModel's database queue with $T/$PK parsing)
 + (NSArray * _Nullable)resultDictionariesFromQuery:(NSString * _Nullable)query, ...;
 + (NSArray * _Nullable)resultDictionariesFromQuery:(NSString * _Nullable)query arguments:(NSArray * _Nullable)arguments;
++ (void)enumerateResultDictionariesFromQuery:(NSString * _Nullable)query arguments:(NSArray * _Nullable)arguments usingBlock:(void (^ _Nonnull)(NSDictionary * _Nonnull row, BOOL * _Nonnull stop))block;
 
 + (NSArray * _Nullable)firstColumnArrayFromQuery:(NSString * _Nullable)query, ...;
 + (NSArray * _Nullable)firstColumnArrayFromQuery:(NSString * _Nullable)query arguments:(NSArray * _Nullable)arguments;
@@ -135,9 +256,13 @@ typedef NS_ENUM(NSInteger, FCModelChangeType) {
 + (id _Nullable)firstValueFromQuery:(NSString * _Nullable)query, ...;
 + (id _Nullable)firstValueFromQuery:(NSString * _Nullable)query arguments:(NSArray * _Nullable)arguments;
 
-// These methods use a global query cache (in FCModelCachedObject). Results are cached indefinitely until their
-//  table has any writes or there's a system low-memory warning, at which point they automatically invalidate.
+// These methods use a global query cache (in FCModelCachedObject). Results are cached until their table has any
+//  writes, there's a system low-memory warning, or they're evicted under the cache's cost limit (see below).
 //  You can customize whether invalidations are triggered with the optional ignoreFieldsForInvalidation: params.
+// cachedInstancesWhere results are only invalidated by inserts, deletes, and updates to the fields that the query
+//  after WHERE reads (its conditions and ORDER BY), since the cached instances themselves reflect other updates.
+// When the changed rows are known, the cached array is then updated by re-checking only those rows, unless the query
+//  uses LIMIT, GROUP BY, or an ORDER BY on anything but plain number, date, or text fields.
 // The next subsequent request will repopulate the cached data, either by querying the DB (cachedInstancesWhere)
 //  or calling the generator block (cachedObjectWithIdentifier).
 //
@@ -146,12 +271,23 @@ typedef NS_ENUM(NSInteger, FCModelChangeType) {
 + (NSArray * _Nullable)cachedInstancesWhere:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments ignoreFieldsForInvalidation:(NSSet * _Nullable)ignoredFields;
 + (id _Nullable)cachedObjectWithIdentifier:(id _Nonnull)identifier generator:(id _Nullable (^ _Nonnull)(void))generatorBlock;
 + (id _Nullable)cachedObjectWithIdentifier:(id _Nonnull)identifier ignoreFieldsForInvalidation:(NSSet * _Nullable)ignoredFields generator:(id _Nullable (^ _Nonnull)(void))generatorBlock;
+//
+// The cache can be given a total cost limit with [FCModelCachedObject setCacheCostLimit:], after which the least recently
+//  used results are evicted. Query results cost their instance count. Generated objects cost their element count if
+//  they're collections, 1 otherwise, or the cost supplied here:
++ (id _Nullable)cachedObjectWithIdentifier:(id _Nonnull)identifier ignoreFieldsForInvalidation:(NSSet * _Nullable)ignoredFields cost:(NSUInteger)cost generator:(id _Nullable (^ _Nonnull)(void))generatorBlock;
 
 // For subclasses to override, optional:
 - (void)didInit;
 
 + (NSSet * _Nonnull)ignoredFieldNames; // Fields that exist in the table but should not be read into the model. Default empty set, cannot be nil.
 
+// By default, unsaved changes are found by comparing every field against its database value. Return YES to find them
+//  by intercepting the setters of database-mapped properties instead, so checking them only costs as much as the number
+//  of fields that have been set. Only do so if your subclass never assigns a field's instance variable directly
+//  (bypassing its setter), since such changes would be missed and never saved. Ignored for Swift classes.
++ (BOOL)tracksChangesWithSetters;
+
 // Safe-writing helpers:
 //  - reload: reloads the current database values into this instance, overwriting any unsaved changes
 //
@@ -168,6 +304,11 @@ typedef NS_ENUM(NSInteger, FCModelChangeType) {
 - (BOOL)save:(void (^ _Nullable)(void))modificiationsBlock;
 - (BOOL)saveWithoutChangeNotifications:(void (^ _Nullable)(void))modificiationsBlock;
 
+// Asynchronous save: modificiationsBlock and the save are executed later on the database queue, and completion is called
+//  on completionQueue (or the main queue if nil or unspecified) with the same result that save: would have returned.
+- (void)saveAsync:(void (^ _Nullable)(void))modificiationsBlock completion:(void (^ _Nullable)(BOOL success))completion;
+- (void)saveAsync:(void (^ _Nullable)(void))modificiationsBlock completionQueue:(dispatch_queue_t _Nullable)completionQueue completion:(void (^ _Nullable)(BOOL success))completion;
+
 // When using SwiftUI/Combine, call this to trigger a refresh manually if you modify fields outside of
 //  the usual save/reload/update methods, or after modifying other properties that aren't database columns
 - (void)observableObjectPropertiesWillChange;
@@ -177,6 +318,13 @@ typedef NS_ENUM(NSInteger, FCModelChangeType) {
 + (void)addObserver:(id _Nonnull)target selector:(SEL _Nonnull)action forAnyChangedFieldsExcept:(NSSet * _Nullable)fieldNamesToIgnore;
 + (void)removeObserverForFieldChanges:(id _Nonnull)target;
 
+// Call on an instance to be notified only when its row changes, including through executeUpdateQuery: or raw SQL.
+//  If a notification doesn't say which rows changed, every instance observer of the class is notified. Observers of a
+//  new instance follow it if its generated primary key is replaced when it's first saved.
+//  fieldNamesToWatch may be nil for changes to any field. +removeObserverForFieldChanges: also removes these.
+- (void)addObserver:(id _Nonnull)target selector:(SEL _Nonnull)action forChangedFields:(NSSet * _Nullable)fieldNamesToWatch;
+- (void)removeObserverForFieldChanges:(id _Nonnull)target;
+
 // To create new records with supplied primary-key values, call instanceWithPrimaryKey:, then save when done
 //  setting other fields.
 //
@@ -189,6 +337,21 @@ typedef NS_ENUM(NSInteger, FCModelChangeType) {
 //
 + (id _Nonnull)primaryKeyValueForNewInstance;
 
+// How +new makes sure its generated primary-key value is unused. Subclasses may override; the default is
+//  FCModelPrimaryKeyGenerationCheckDatabase.
+//
+//  - CheckDatabase: reads the table for each generated value (one SELECT per new instance) and skips loaded instances' keys.
+//  - CheckLoadedInstances: only skips loaded instances' keys. If the value turns out to exist in the table, the INSERT
+//      fails on the primary-key constraint and the instance gets a new value from primaryKeyValueForNewInstance, then
+//      the save is retried. Best with random 64-bit keys, where collisions are very unlikely.
+//  - Sequential: ignores primaryKeyValueForNewInstance and issues increasing integers, starting after the table's
+//      largest key (read once per class after opening the database). Integer primary keys only. Collisions with
+//      rows inserted by other means are retried as with CheckLoadedInstances.
+//
+// With the latter two, a new instance's primary key can change when it's first saved.
+//
++ (FCModelPrimaryKeyGeneration)primaryKeyGeneration;
+
 // Transactions:
 //  - Cannot be nested
 //  - Enqueue and coalesce change notifications until commit (and are discarded if the transaction is rolled back)
@@ -200,6 +363,18 @@ typedef NS_ENUM(NSInteger, FCModelChangeType) {
 // This variant has no control over commit/rollback; safe to potentially nest inside other transactions if you only want performance
 + (void)performInTransactionForPerformance:(void (^ _Nonnull)(void))block;
 
+// Group commit: when enabled, saves outside of an explicit transaction that occur within windowSeconds of the first one
+//  are committed together in a single transaction, instead of each paying for its own commit and fsync.
+//  - Their change notifications are queued and coalesced (per class, without FCModelInstanceKey) until the group commits.
+//  - The group commits when the window elapses, after maxSaveCount saves (0 for no limit), or before any transaction,
+//      delete, inDatabaseSync:, executeUpdateQuery:, or closeDatabase call.
+//  - isInTransaction doesn't count an open group commit.
+//  - Call flushGroupCommit when you need pending saves to be durable (and visible to other readers) right away.
+// A window of 0 (the default) disables group commit.
+//
++ (void)setGroupCommitWindow:(NSTimeInterval)windowSeconds maxSaveCount:(NSUInteger)maxSaveCount;
++ (void)flushGroupCommit;
+
 // Field info: You probably won't need this most of the time, but it's nice to have sometimes. FCModel's generating this privately
 //  anyway, so you might as well have read-only access to it if it can help you avoid some code. (I've already needed it.)
 //
@@ -249,3 +424,24 @@ typedef NS_ENUM(NSInteger, FCModelFieldType) {
 @property (nonatomic, readonly) NSString * _Nonnull propertyTypeEncoding;
 @end
 
+
+// Keyset ("seek") pagination: pages through a class's instances in a stable order by remembering the sort-field and
+//  primary-key values at the edges of the current page and querying relative to them, e.g. WHERE (date, id) > (?, ?),
+//  so every page costs the same no matter how deep it is (unlike LIMIT/OFFSET).
+//  - Ordered by sortFieldName, then the primary key to break ties. Pass nil to order by the primary key alone.
+//  - Rows with NULL sort values are included, ordered as SQLite orders them: first when ascending, last when descending.
+//  - queryAfterWHERE must not include ORDER BY or LIMIT clauses.
+//  - Not thread-safe: use each cursor from one thread at a time.
+//
+@interface FCModelCursor : NSObject
+
+- (instancetype _Nonnull)initWithModelClass:(Class _Nonnull)modelClass where:(NSString * _Nullable)queryAfterWHERE arguments:(NSArray * _Nullable)arguments orderedBy:(NSString * _Nullable)sortFieldName ascending:(BOOL)ascending pageSize:(NSUInteger)pageSize;
+
+- (NSArray * _Nonnull)nextPage;     // The page after the current one (the first page initially), or an empty array at the end
+- (NSArray * _Nonnull)previousPage; // The page before the current one, or an empty array at the beginning
+- (void)reset;                      // The next call to nextPage returns the first page again
+
+@property (nonatomic, readonly) NSUInteger pageSize;
+
+@end
+
@@ -64,7 +64,7 @@ static NSTimer *queryProfilePrintSummaryTimer = nil;
 static NSTimer *queryProfileResetTimer = nil;
 static void queryProfileInit(void)
 {
-    fcm_onMainQueue(^{
+    dispatch_async(dispatch_get_main_queue(), ^{
         queryProfilePrintSummaryTimer = [NSTimer scheduledTimerWithTimeInterval:5.0 repeats:YES block:^(NSTimer *timer) {
             queryProfilePrintSummary();
         }];
@@ -101,6 +101,10 @@ NSString * const FCModelInstanceKey = @"FCModelInstanceKey";
 NSString * const FCModelChangedFieldsKey = @"FCModelChangedFieldsKey";
 NSString * const FCModelChangeTypeKey = @"FCModelChangeTypeKey";
 NSString * const FCModelOldFieldValuesKey = @"FCModelOldFieldValuesKey";
+NSString * const FCModelInsertedPrimaryKeyValuesKey = @"FCModelInsertedPrimaryKeyValuesKey";
+NSString * const FCModelUpdatedPrimaryKeyValuesKey = @"FCModelUpdatedPrimaryKeyValuesKey";
+NSString * const FCModelDeletedPrimaryKeyValuesKey = @"FCModelDeletedPrimaryKeyValuesKey";
+NSString * const FCModelChangedRowIDsKey = @"FCModelChangedRowIDsKey";
 NSString * const FCModelWillSendChangeNotification = @"FCModelWillSendChangeNotification"; // for FCModelCachedObject
 
 static NSMutableDictionary *g_instances = NULL;
@@ -108,8 +112,337 @@ static FCModelDatabase *g_database = NULL;
 static NSDictionary *g_fieldInfo = NULL;
 static NSDictionary *g_ignoredFieldNames = NULL;
 static NSDictionary *g_primaryKeyFieldName = NULL;
+static NSDictionary *g_classSQL = NULL;
+static NSDictionary *g_trackedFieldNames = NULL; // class -> non-PK field names, indexed by dirty-bit position, for classes using setter tracking
+static NSDictionary *g_orderedFieldNames = NULL; // class -> all field names, indexed by position in row snapshots
+static NSDictionary *g_fieldOrdinals = NULL; // class -> { field name : position in row snapshots }
+static NSDictionary *g_rowSnapshotKinds = NULL; // class -> NSData of FCModelRowSnapshotKind, indexed by position in row snapshots
+static NSSet *g_rowIDPrimaryKeyClasses = NULL; // classes whose primary key is an alias for the rowid (INTEGER PRIMARY KEY)
+static NSSet *g_fieldValuesInitClasses = NULL; // classes overriding -initWithFieldValues:existsInDatabaseAlready:, so rows are hydrated through it
+static NSMutableArray *g_changeTrackingSetters = NULL; // [class, setter name, original IMP] for each installed tracking setter
+static NSMutableDictionary *g_originalIMPsByTrackingIMP = NULL;
 static NSString *g_modulePrefix = NULL;
 static void (^dbErrorHandler)(NSException *proposedException, int dbErrorCode, NSString *dbErrorMessage) = NULL;
+static NSMutableDictionary *g_lastSequentialPrimaryKeys = NULL; // class -> last key issued by FCModelPrimaryKeyGenerationSequential, only accessed on g_instancesQueue
+static NSTimeInterval g_groupCommitWindow = 0;
+static NSUInteger g_groupCommitMaxSaveCount = 0;
+
+// All database work and identity-map access runs here: on the main queue by default, or on the database's private
+//  serial queue if it was opened with FCModelDatabaseOptionPrivateQueue.
+void fcm_onDatabaseQueue(void (^block)(void))
+{
+    FCModelDatabase *database = g_database;
+    if (database) [database performSync:block];
+    else fcm_onMainQueue(block);
+}
+
+BOOL fcm_isOnDatabaseQueue(void)
+{
+    FCModelDatabase *database = g_database;
+    return database ? database.isOnDatabaseQueue : NSThread.isMainThread;
+}
+
+// The primary keys of the rows a change notification reports changing, or nil if they aren't known
+NSSet *fcm_primaryKeysChangedByNotification(NSNotification *n)
+{
+    FCModel *instance = n.userInfo[FCModelInstanceKey];
+    if (instance) {
+        id primaryKey = instance.primaryKey;
+        return primaryKey ? [NSSet setWithObject:primaryKey] : nil;
+    }
+
+    NSSet *insertedKeys = n.userInfo[FCModelInsertedPrimaryKeyValuesKey];
+    NSSet *updatedKeys = n.userInfo[FCModelUpdatedPrimaryKeyValuesKey];
+    NSSet *deletedKeys = n.userInfo[FCModelDeletedPrimaryKeyValuesKey];
+    if (! insertedKeys || ! updatedKeys || ! deletedKeys) return nil;
+
+    NSMutableSet *changedKeys = [updatedKeys mutableCopy];
+    [changedKeys unionSet:insertedKeys];
+    [changedKeys unionSet:deletedKeys];
+    return changedKeys;
+}
+
+static void fcm_postChangeNotification(Class class, NSDictionary *userInfo);
+
+static const NSUInteger FCModelMaxKeyChangesPerClass = 10000;
+
+// The primary keys of one class's rows changed by a notification without an instance, or while its notifications are
+//  queued. Keys are kept by net effect: a row inserted and then updated is only inserted, one inserted and then deleted
+//  is dropped, and one deleted and then inserted again is updated. After a change to unknown rows, or too many keys,
+//  the set is incomplete and no keys are reported.
+@interface FCModelKeyChanges : NSObject
+@property (nonatomic, readonly) NSMutableSet *insertedKeys;
+@property (nonatomic, readonly) NSMutableSet *updatedKeys;
+@property (nonatomic, readonly) NSMutableSet *deletedKeys;
+@property (nonatomic, readonly) BOOL incomplete;
+- (void)recordChangeType:(FCModelChangeType)changeType primaryKeyValue:(id)primaryKeyValue;
+- (void)addChanges:(FCModelKeyChanges *)changes; // nil for unknown changes
+- (void)markIncomplete;
+- (void)addToUserInfo:(NSMutableDictionary *)userInfo;
+@end
+
+@implementation FCModelKeyChanges
+
+- (instancetype)init
+{
+    if ( (self = [super init]) ) {
+        _insertedKeys = [NSMutableSet set];
+        _updatedKeys = [NSMutableSet set];
+        _deletedKeys = [NSMutableSet set];
+    }
+    return self;
+}
+
+- (void)recordChangeType:(FCModelChangeType)changeType primaryKeyValue:(id)key
+{
+    if (_incomplete) return;
+    if (! key || changeType == FCModelChangeTypeUnspecified) { [self markIncomplete]; return; }
+    
+    switch (changeType) {
+        case FCModelChangeTypeInsert:
+            if ([_deletedKeys containsObject:key]) {
+                [_deletedKeys removeObject:key];
+                [_updatedKeys addObject:key];
+            } else {
+                [_insertedKeys addObject:key];
+            }
+            break;
+        case FCModelChangeTypeUpdate:
+            if (! [_insertedKeys containsObject:key]) [_updatedKeys addObject:key];
+            break;
+        case FCModelChangeTypeDelete:
+            if ([_insertedKeys containsObject:key]) {
+                [_insertedKeys removeObject:key];
+            } else {
+                [_updatedKeys removeObject:key];
+                [_deletedKeys addObject:key];
+            }
+            break;
+        default: break;
+    }
+    
+    if (_insertedKeys.count + _updatedKeys.count + _deletedKeys.count > FCModelMaxKeyChangesPerClass) [self markIncomplete];
+}
+
+- (void)addChanges:(FCModelKeyChanges *)changes
+{
+    if (_incomplete) return;
+    if (! changes || changes.incomplete) { [self markIncomplete]; return; }
+    for (id key in changes.deletedKeys) [self recordChangeType:FCModelChangeTypeDelete primaryKeyValue:key];
+    for (id key in changes.insertedKeys) [self recordChangeType:FCModelChangeTypeInsert primaryKeyValue:key];
+    for (id key in changes.updatedKeys) [self recordChangeType:FCModelChangeTypeUpdate primaryKeyValue:key];
+}
+
+- (void)markIncomplete
+{
+    _incomplete = YES;
+    [_insertedKeys removeAllObjects];
+    [_updatedKeys removeAllObjects];
+    [_deletedKeys removeAllObjects];
+}
+
+- (void)addToUserInfo:(NSMutableDictionary *)userInfo
+{
+    if (_incomplete) return;
+    userInfo[FCModelInsertedPrimaryKeyValuesKey] = [_insertedKeys copy];
+    userInfo[FCModelUpdatedPrimaryKeyValuesKey] = [_updatedKeys copy];
+    userInfo[FCModelDeletedPrimaryKeyValuesKey] = [_deletedKeys copy];
+}
+
+@end
+
+// Posts the queued notifications in changedFieldsByClass, with the keys from keyChangesByClass
+static void fcm_postQueuedChangeNotifications(NSDictionary *changedFieldsByClass, NSDictionary *keyChangesByClass, void (^beforePosting)(Class class))
+{
+    NSMutableDictionary *userInfoByClass = [NSMutableDictionary dictionaryWithCapacity:changedFieldsByClass.count];
+    [changedFieldsByClass enumerateKeysAndObjectsUsingBlock:^(Class class, NSSet *changedFields, BOOL *stop) {
+        NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObject:changedFields forKey:FCModelChangedFieldsKey];
+        [(FCModelKeyChanges *) keyChangesByClass[class] addToUserInfo:userInfo];
+        userInfoByClass[(id) class] = userInfo;
+        [NSNotificationCenter.defaultCenter postNotificationName:FCModelWillSendChangeNotification object:class userInfo:userInfo];
+        if (beforePosting) beforePosting(class);
+    }];
+    [userInfoByClass enumerateKeysAndObjectsUsingBlock:^(Class class, NSDictionary *userInfo, BOOL *stop) {
+        fcm_postChangeNotification(class, userInfo);
+    }];
+}
+
+// Posts everything queued in enqueuedChangedFieldsByClass (e.g. by a transaction or group commit) and clears the queue
+static void fcm_postEnqueuedChangeNotifications(void)
+{
+    g_database.isQueuingNotifications = NO;
+    NSDictionary *changedFieldsToNotify = [g_database.enqueuedChangedFieldsByClass copy];
+    NSDictionary *keyChangesToNotify = [g_database.enqueuedKeyChangesByClass copy];
+    [g_database.enqueuedChangedFieldsByClass removeAllObjects];
+    [g_database.enqueuedKeyChangesByClass removeAllObjects];
+    fcm_postQueuedChangeNotifications(changedFieldsToNotify, keyChangesToNotify, nil);
+}
+
+// The identity map (g_instances) can be accessed from concurrent reader threads, so all access goes through these
+//  functions on a serial queue. Never run database work or model code (e.g. -didInit) inside g_instancesQueue.
+static dispatch_queue_t g_instancesQueue = NULL;
+
+static void fcm_onInstancesQueue(void (^block)(void))
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{ g_instancesQueue = dispatch_queue_create("FCModelInstances", DISPATCH_QUEUE_SERIAL); });
+    dispatch_sync(g_instancesQueue, block);
+}
+
+static FCModel *fcm_loadedInstance(Class class, id primaryKeyValue)
+{
+    __block FCModel *instance = nil;
+    fcm_onInstancesQueue(^{ instance = [g_instances[class] objectForKey:primaryKeyValue]; });
+    return instance;
+}
+
+// Returns the instance that ends up registered, which is a different one if another thread registered that key first
+static FCModel *fcm_registerLoadedInstance(Class class, id primaryKeyValue, FCModel *instance)
+{
+    __block FCModel *registeredInstance = nil;
+    fcm_onInstancesQueue(^{
+        if (! g_instances) g_instances = [NSMutableDictionary dictionary];
+        NSMapTable *classCache = g_instances[class];
+        if (! classCache) classCache = g_instances[(id) class] = [NSMapTable strongToWeakObjectsMapTable];
+        registeredInstance = [classCache objectForKey:primaryKeyValue];
+        if (! registeredInstance) [classCache setObject:(registeredInstance = instance) forKey:primaryKeyValue];
+    });
+    return registeredInstance;
+}
+
+static void fcm_unregisterLoadedInstance(Class class, id primaryKeyValue)
+{
+    if (! primaryKeyValue) return;
+    fcm_onInstancesQueue(^{ [g_instances[class] removeObjectForKey:primaryKeyValue]; });
+}
+
+static NSArray *fcm_loadedInstancesOfClass(Class class)
+{
+    __block NSArray *instances = nil;
+    fcm_onInstancesQueue(^{
+        NSMapTable *classCache = g_instances ? g_instances[class] : nil;
+        instances = classCache.objectEnumerator.allObjects;
+    });
+    return instances ?: @[];
+}
+
+// Change notifications are always delivered on the main queue. With a private database queue, that means asynchronously,
+//  since the main queue may itself be waiting on the database queue.
+static void fcm_postChangeNotification(Class class, NSDictionary *userInfo)
+{
+    if (g_database.usesPrivateQueue && ! NSThread.isMainThread) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [NSNotificationCenter.defaultCenter postNotificationName:FCModelChangeNotification object:class userInfo:userInfo];
+        });
+    } else {
+        [NSNotificationCenter.defaultCenter postNotificationName:FCModelChangeNotification object:class userInfo:userInfo];
+    }
+}
+
+// The database values of an instance whose class doesn't use setter tracking, in one allocation: an 8-byte slot per
+//  field (in g_orderedFieldNames order) holding the raw value of a primitive property or a retained object, then a
+//  bitmap of NULL fields. Primitives are boxed only when read, so hydrating a row never boxes them.
+typedef NS_ENUM(char, FCModelRowSnapshotKind) {
+    FCModelRowSnapshotKindObject = 0,
+    FCModelRowSnapshotKindInteger,
+    FCModelRowSnapshotKindUnsignedInteger,
+    FCModelRowSnapshotKindReal,
+};
+
+typedef union {
+    int64_t integer;
+    uint64_t unsignedInteger;
+    double real;
+    const void *object;
+} FCModelRowSnapshotValue;
+
+typedef struct {
+    NSUInteger count;
+    uint64_t *nullBits;
+    FCModelRowSnapshotKind *kinds;
+    FCModelRowSnapshotValue values[];
+} FCModelRowSnapshot;
+
+static FCModelRowSnapshotKind fcm_rowSnapshotKindForValueType(char valueType)
+{
+    switch (valueType) {
+        case 'c': case 'C': case 'B': case 's': case 'S': case 'i': case 'I': case 'l': case 'q': return FCModelRowSnapshotKindInteger;
+        case 'L': case 'Q': return FCModelRowSnapshotKindUnsignedInteger;
+        case 'f': case 'd': return FCModelRowSnapshotKindReal;
+        default: return FCModelRowSnapshotKindObject;
+    }
+}
+
+// Every field starts out NULL
+static FCModelRowSnapshot *fcm_rowSnapshotCreate(NSData *kinds)
+{
+    NSUInteger count = kinds.length, nullWordCount = MAX(1, (count + 63) / 64);
+    FCModelRowSnapshot *snapshot = calloc(1, sizeof(FCModelRowSnapshot) + (count + nullWordCount) * sizeof(uint64_t) + count);
+    snapshot->count = count;
+    snapshot->nullBits = (uint64_t *) &snapshot->values[count];
+    snapshot->kinds = (FCModelRowSnapshotKind *) &snapshot->nullBits[nullWordCount];
+    memset(snapshot->nullBits, 0xFF, nullWordCount * sizeof(uint64_t));
+    memcpy(snapshot->kinds, kinds.bytes, count);
+    return snapshot;
+}
+
+static void fcm_rowSnapshotFree(FCModelRowSnapshot *snapshot)
+{
+    if (! snapshot) return;
+    for (NSUInteger i = 0; i < snapshot->count; i++) {
+        if (snapshot->kinds[i] == FCModelRowSnapshotKindObject && snapshot->values[i].object) CFRelease(snapshot->values[i].object);
+    }
+    free(snapshot);
+}
+
+static inline void fcm_rowSnapshotSetNull(FCModelRowSnapshot *snapshot, NSUInteger ordinal, BOOL isNull)
+{
+    uint64_t bit = 1ULL << (ordinal % 64);
+    if (isNull) snapshot->nullBits[ordinal / 64] |= bit;
+    else snapshot->nullBits[ordinal / 64] &= ~bit;
+}
+
+// value is nil or NSNull for NULL
+static void fcm_rowSnapshotSetValue(FCModelRowSnapshot *snapshot, NSUInteger ordinal, id value)
+{
+    if (value == NSNull.null) value = nil;
+    FCModelRowSnapshotValue *slot = &snapshot->values[ordinal];
+    switch (snapshot->kinds[ordinal]) {
+        case FCModelRowSnapshotKindObject:
+            if (slot->object) CFRelease(slot->object);
+            slot->object = value ? CFBridgingRetain(value) : NULL;
+            break;
+        case FCModelRowSnapshotKindInteger: slot->integer = [value longLongValue]; break;
+        case FCModelRowSnapshotKindUnsignedInteger: slot->unsignedInteger = [value unsignedLongLongValue]; break;
+        case FCModelRowSnapshotKindReal: slot->real = [value doubleValue]; break;
+    }
+    fcm_rowSnapshotSetNull(snapshot, ordinal, value == nil);
+}
+
+// For a non-NULL column of a primitive field, without boxing it
+static inline void fcm_rowSnapshotSetColumn(FCModelRowSnapshot *snapshot, NSUInteger ordinal, sqlite3_stmt *statement, int column)
+{
+    FCModelRowSnapshotValue *slot = &snapshot->values[ordinal];
+    switch (snapshot->kinds[ordinal]) {
+        case FCModelRowSnapshotKindReal: slot->real = sqlite3_column_double(statement, column); break;
+        default: slot->integer = sqlite3_column_int64(statement, column); break;
+    }
+    fcm_rowSnapshotSetNull(snapshot, ordinal, NO);
+}
+
+// nil for NULL
+static id fcm_rowSnapshotValue(FCModelRowSnapshot *snapshot, NSUInteger ordinal)
+{
+    if (snapshot->nullBits[ordinal / 64] & (1ULL << (ordinal % 64))) return nil;
+    FCModelRowSnapshotValue slot = snapshot->values[ordinal];
+    switch (snapshot->kinds[ordinal]) {
+        case FCModelRowSnapshotKindObject: return (__bridge id) slot.object;
+        case FCModelRowSnapshotKindInteger: return [NSNumber numberWithLongLong:slot.integer];
+        case FCModelRowSnapshotKindUnsignedInteger: return [NSNumber numberWithUnsignedLongLong:slot.unsignedInteger];
+        case FCModelRowSnapshotKindReal: return [NSNumber numberWithDouble:slot.real];
+    }
+    return nil;
+}
 
 typedef NS_ENUM(char, FCModelInDatabaseStatus) {
     FCModelInDatabaseStatusNotYetInserted = 0,
@@ -119,9 +452,19 @@ typedef NS_ENUM(char, FCModelInDatabaseStatus) {
 
 @interface FCModel () {
     FCModelInDatabaseStatus _inDatabaseStatus;
+    uint64_t *_dirtyFieldBits; // one bit per g_trackedFieldNames entry, allocated on first tracked set
+    NSUInteger _dirtyFieldWordCount;
+    
+    // What's in the database for this row. Classes with setter tracking keep no snapshot, since their clean fields'
+    //  current values are the database values: only the prior values of fields set since the last load or save are kept.
+    //  Other classes keep every field's value in a compact FCModelRowSnapshot.
+    NSMutableDictionary *_databaseValuesOfSetFields;
+    FCModelRowSnapshot *_rowSnapshot;
+    
+    BOOL _primaryKeyIsGenerated; // may be replaced if it collides with an existing row at insert time
 }
-@property (nonatomic, copy) NSDictionary *_rowValuesInDatabase;
 + (void)postChangeNotificationWithChangedFields:(NSSet *)changedFields changedObject:(FCModel *)changedObject changeType:(FCModelChangeType)changeType priorFieldValues:(NSDictionary *)priorFieldValues;
+- (id)databaseValueForFieldName:(NSString *)fieldName;
 @end
 
 static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
@@ -140,6 +483,9 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 @property (nonatomic) id defaultValue;
 @property (nonatomic) Class propertyClass;
 @property (nonatomic) NSString *propertyTypeEncoding;
+@property (nonatomic) char valueType; // first character of propertyTypeEncoding, e.g. 'q', 'd', '@'
+@property (nonatomic) SEL setter;
+@property (nonatomic) IMP setterIMP; // NULL if the class has no setter method for the property
 @end
 
 @implementation FCModelFieldInfo
@@ -153,6 +499,258 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 }
 @end
 
+// The CRUD statements FCModel generates for each class, built once when the database is opened. Each is added to the
+//  database's cached statements, so reusing the identical SQL string also reuses the prepared statement (reset and
+//  rebound, not re-prepared). UPDATE and upsert statements are added as each distinct set of columns is first used.
+@interface FCModelClassSQL : NSObject
+@property (nonatomic, copy) NSString *selectByPrimaryKey;
+@property (nonatomic, copy) NSString *reloadByPrimaryKey;
+@property (nonatomic, copy) NSString *deleteByPrimaryKey;
+@property (nonatomic, copy) NSString *insert;
+@property (nonatomic, copy) NSArray *insertColumnNames; // values are bound in this order, followed by the primary key
+@property (nonatomic, copy) NSString *tableName;
+@property (nonatomic, copy) NSString *primaryKeyName;
+@property (nonatomic) NSMutableDictionary *updatesByColumnNames; // only accessed on the database queue
+@property (nonatomic) NSMutableDictionary *upsertsByColumnNames; // only accessed on the database queue
+- (instancetype)initWithTableName:(NSString *)tableName primaryKeyName:(NSString *)pkName fieldNames:(NSArray *)fieldNames;
+- (NSString *)updateForColumnNames:(NSArray *)sortedColumnNames;
+- (NSString *)upsertForColumnNames:(NSArray *)sortedColumnNames; // values are bound in this order, followed by the primary key
+@end
+
+@implementation FCModelClassSQL
+
+- (instancetype)initWithTableName:(NSString *)tableName primaryKeyName:(NSString *)pkName fieldNames:(NSArray *)fieldNames
+{
+    if ( (self = [super init]) ) {
+        self.tableName = tableName;
+        self.primaryKeyName = pkName;
+        self.updatesByColumnNames = [NSMutableDictionary dictionary];
+        self.upsertsByColumnNames = [NSMutableDictionary dictionary];
+        self.selectByPrimaryKey = [NSString stringWithFormat:@"SELECT * FROM \"%@\" WHERE \"%@\"=?", tableName, pkName];
+        self.reloadByPrimaryKey = [_selectByPrimaryKey stringByAppendingString:@" -- reload"];
+        self.deleteByPrimaryKey = [NSString stringWithFormat:@"DELETE FROM \"%@\" WHERE \"%@\" = ?", tableName, pkName];
+
+        NSMutableArray *columnNamesMinusPK = [[fieldNames sortedArrayUsingSelector:@selector(compare:)] mutableCopy];
+        [columnNamesMinusPK removeObject:pkName];
+        self.insertColumnNames = columnNamesMinusPK;
+        if (columnNamesMinusPK.count > 0) {
+            self.insert = [NSString stringWithFormat:
+                @"INSERT INTO \"%@\" (\"%@\",\"%@\") VALUES (%@?)",
+                tableName,
+                [columnNamesMinusPK componentsJoinedByString:@"\",\""],
+                pkName,
+                [@"" stringByPaddingToLength:(columnNamesMinusPK.count * 2) withString:@"?," startingAtIndex:0]
+            ];
+        } else {
+            self.insert = [NSString stringWithFormat:@"INSERT INTO \"%@\" (\"%@\") VALUES (?)", tableName, pkName];
+        }
+
+        for (NSString *query in @[ _selectByPrimaryKey, _reloadByPrimaryKey, _deleteByPrimaryKey, _insert ]) [g_database addCachedStatementSQL:query];
+    }
+    return self;
+}
+
+- (NSString *)updateForColumnNames:(NSArray *)sortedColumnNames
+{
+    NSString *query = _updatesByColumnNames[sortedColumnNames];
+    if (! query) {
+        query = [NSString stringWithFormat:
+            @"UPDATE \"%@\" SET \"%@\"=? WHERE \"%@\"=?",
+            _tableName,
+            [sortedColumnNames componentsJoinedByString:@"\"=?,\""],
+            _primaryKeyName
+        ];
+        _updatesByColumnNames[[sortedColumnNames copy]] = query;
+        [g_database addCachedStatementSQL:query];
+    }
+    return query;
+}
+
+- (NSString *)upsertForColumnNames:(NSArray *)sortedColumnNames
+{
+    NSString *query = _upsertsByColumnNames[sortedColumnNames];
+    if (! query) {
+        if (sortedColumnNames.count > 0) {
+            NSMutableArray *assignments = [NSMutableArray arrayWithCapacity:sortedColumnNames.count];
+            for (NSString *columnName in sortedColumnNames) [assignments addObject:[NSString stringWithFormat:@"\"%@\"=excluded.\"%@\"", columnName, columnName]];
+            query = [NSString stringWithFormat:
+                @"INSERT INTO \"%@\" (\"%@\",\"%@\") VALUES (%@?) ON CONFLICT(\"%@\") DO UPDATE SET %@",
+                _tableName,
+                [sortedColumnNames componentsJoinedByString:@"\",\""],
+                _primaryKeyName,
+                [@"" stringByPaddingToLength:(sortedColumnNames.count * 2) withString:@"?," startingAtIndex:0],
+                _primaryKeyName,
+                [assignments componentsJoinedByString:@","]
+            ];
+        } else {
+            query = [NSString stringWithFormat:@"INSERT INTO \"%@\" (\"%@\") VALUES (?) ON CONFLICT(\"%@\") DO NOTHING", _tableName, _primaryKeyName, _primaryKeyName];
+        }
+        _upsertsByColumnNames[[sortedColumnNames copy]] = query;
+        [g_database addCachedStatementSQL:query];
+    }
+    return query;
+}
+
+@end
+
+// Boxes a column value the same way FMResultSet's objectForColumnIndex: does, but returns nil for NULL
+static inline id fcm_columnObject(sqlite3_stmt *statement, int columnIndex)
+{
+    switch (sqlite3_column_type(statement, columnIndex)) {
+        case SQLITE_NULL:    return nil;
+        case SQLITE_INTEGER: return [NSNumber numberWithLongLong:sqlite3_column_int64(statement, columnIndex)];
+        case SQLITE_FLOAT:   return [NSNumber numberWithDouble:sqlite3_column_double(statement, columnIndex)];
+        case SQLITE_BLOB:    return [NSData dataWithBytes:sqlite3_column_blob(statement, columnIndex) length:(NSUInteger) sqlite3_column_bytes(statement, columnIndex)];
+        default: {
+            const char *text = (const char *) sqlite3_column_text(statement, columnIndex);
+            return text ? [NSString stringWithUTF8String:text] : nil;
+        }
+    }
+}
+
+// Maps a result set's columns to a model class's fields once per statement, so each row can be hydrated by column index:
+//  values are read straight from sqlite3_column_* and passed to the properties' setter IMPs, with no row dictionary,
+//  no KVC, and no boxing on the way into primitive properties.
+@interface FCModelRowHydrator : NSObject
+- (instancetype)initWithModelClass:(Class)modelClass resultSet:(FMResultSet *)resultSet;
+- (id)primaryKeyValue;
+- (FCModelRowSnapshot *)hydrateInstance:(FCModel *)instance; // returns the row snapshot (owned by the caller), or NULL if the class doesn't keep one
+- (NSDictionary *)fieldValues; // the row as a dictionary, for initWithFieldValues:existsInDatabaseAlready:
+@end
+
+@implementation FCModelRowHydrator {
+    sqlite3_stmt *_statement;
+    int _primaryKeyColumn;
+    int _fieldCount;
+    int *_columns;
+    char *_valueTypes;
+    SEL *_setters;
+    IMP *_setterIMPs;
+    NSUInteger *_snapshotOrdinals;
+    NSData *_snapshotKinds; // nil if the class doesn't keep row snapshots
+    NSArray *_fieldNames;
+    NSDictionary *_defaultValuesForMissingFields;
+}
+
+- (instancetype)initWithModelClass:(Class)modelClass resultSet:(FMResultSet *)resultSet
+{
+    if ( (self = [super init]) ) {
+        _statement = resultSet.statement.statement;
+        _primaryKeyColumn = -1;
+        
+        NSDictionary *fieldInfo = g_fieldInfo[modelClass];
+        NSString *pkName = g_primaryKeyFieldName[modelClass];
+        int columnCount = sqlite3_column_count(_statement);
+        _columns = malloc(sizeof(int) * (size_t) MAX(1, columnCount));
+        _valueTypes = malloc(sizeof(char) * (size_t) MAX(1, columnCount));
+        _setters = malloc(sizeof(SEL) * (size_t) MAX(1, columnCount));
+        _setterIMPs = malloc(sizeof(IMP) * (size_t) MAX(1, columnCount));
+        _snapshotOrdinals = malloc(sizeof(NSUInteger) * (size_t) MAX(1, columnCount));
+        
+        NSDictionary *fieldOrdinals = g_fieldOrdinals[modelClass];
+        _snapshotKinds = g_trackedFieldNames[modelClass] ? nil : g_rowSnapshotKinds[modelClass];
+        
+        NSMutableArray *fieldNames = [NSMutableArray arrayWithCapacity:(NSUInteger) columnCount];
+        NSMutableDictionary *missingFields = [fieldInfo mutableCopy];
+        for (int column = 0; column < columnCount; column++) {
+            NSString *fieldName = [NSString stringWithUTF8String:sqlite3_column_name(_statement, column)];
+            FCModelFieldInfo *info = fieldName ? missingFields[fieldName] : nil;
+            if (! info) continue;
+            [missingFields removeObjectForKey:fieldName];
+            
+            if ([fieldName isEqualToString:pkName]) _primaryKeyColumn = column;
+            _columns[_fieldCount] = column;
+            _valueTypes[_fieldCount] = info.valueType;
+            _setters[_fieldCount] = info.setter;
+            _setterIMPs[_fieldCount] = info.setterIMP;
+            _snapshotOrdinals[_fieldCount] = ((NSNumber *) fieldOrdinals[fieldName]).unsignedIntegerValue;
+            [fieldNames addObject:fieldName];
+            _fieldCount++;
+        }
+        _fieldNames = [fieldNames copy];
+        
+        NSMutableDictionary *defaultValues = [NSMutableDictionary dictionary];
+        [missingFields enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, FCModelFieldInfo *info, BOOL *stop) {
+            if (info.defaultValue) defaultValues[fieldName] = info.defaultValue;
+        }];
+        _defaultValuesForMissingFields = [defaultValues copy];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_columns);
+    free(_valueTypes);
+    free(_setters);
+    free(_setterIMPs);
+    free(_snapshotOrdinals);
+}
+
+- (id)primaryKeyValue { return _primaryKeyColumn < 0 ? nil : fcm_columnObject(_statement, _primaryKeyColumn); }
+
+- (NSDictionary *)fieldValues
+{
+    NSMutableDictionary *fieldValues = [NSMutableDictionary dictionaryWithCapacity:(NSUInteger) _fieldCount];
+    for (int i = 0; i < _fieldCount; i++) fieldValues[_fieldNames[i]] = fcm_columnObject(_statement, _columns[i]) ?: NSNull.null;
+    return fieldValues;
+}
+
+- (FCModelRowSnapshot *)hydrateInstance:(FCModel *)instance
+{
+    FCModelRowSnapshot *snapshot = _snapshotKinds ? fcm_rowSnapshotCreate(_snapshotKinds) : NULL;
+    
+    for (int i = 0; i < _fieldCount; i++) {
+        int column = _columns[i];
+        NSString *fieldName = _fieldNames[i];
+        IMP imp = _setterIMPs[i];
+        SEL setter = _setters[i];
+        char valueType = _valueTypes[i];
+        BOOL isNull = (sqlite3_column_type(_statement, column) == SQLITE_NULL);
+        
+        // Primitives are never boxed here, even for the snapshot
+        id value = (! isNull && (valueType == '@' || ! imp)) ? fcm_columnObject(_statement, column) : nil;
+        if (snapshot) {
+            if (value || isNull) fcm_rowSnapshotSetValue(snapshot, _snapshotOrdinals[i], value);
+            else fcm_rowSnapshotSetColumn(snapshot, _snapshotOrdinals[i], _statement, column);
+        }
+        
+        if (! imp || (isNull && valueType != '@')) {
+            // No direct setter, or NULL for a primitive: let KVC handle it (including -setNilValueForKey:)
+            [instance setValue:value forKey:fieldName];
+            continue;
+        }
+
+#define FCMSetPrimitive(type, columnFunction) ((void (*)(id, SEL, type)) imp)(instance, setter, (type) columnFunction(_statement, column))
+        switch (valueType) {
+            case '@': ((void (*)(id, SEL, id)) imp)(instance, setter, value); break;
+            case 'c': FCMSetPrimitive(char, sqlite3_column_int64); break;
+            case 'C': FCMSetPrimitive(unsigned char, sqlite3_column_int64); break;
+            case 'B': FCMSetPrimitive(bool, sqlite3_column_int64); break;
+            case 's': FCMSetPrimitive(short, sqlite3_column_int64); break;
+            case 'S': FCMSetPrimitive(unsigned short, sqlite3_column_int64); break;
+            case 'i': FCMSetPrimitive(int, sqlite3_column_int64); break;
+            case 'I': FCMSetPrimitive(unsigned int, sqlite3_column_int64); break;
+            case 'l': FCMSetPrimitive(long, sqlite3_column_int64); break;
+            case 'L': FCMSetPrimitive(unsigned long, sqlite3_column_int64); break;
+            case 'q': FCMSetPrimitive(long long, sqlite3_column_int64); break;
+            case 'Q': FCMSetPrimitive(unsigned long long, sqlite3_column_int64); break;
+            case 'f': FCMSetPrimitive(float, sqlite3_column_double); break;
+            case 'd': FCMSetPrimitive(double, sqlite3_column_double); break;
+            default:  [instance setValue:(value ?: fcm_columnObject(_statement, column)) forKey:fieldName]; break;
+        }
+#undef FCMSetPrimitive
+    }
+    
+    [_defaultValuesForMissingFields enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, id defaultValue, BOOL *stop) {
+        [instance setValue:(defaultValue == NSNull.null ? nil : defaultValue) forKey:fieldName];
+    }];
+    
+    return snapshot;
+}
+
+@end
+
 
 
 @implementation FCModel
@@ -183,15 +781,7 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 - (BOOL)existsInDatabase { return _inDatabaseStatus == FCModelInDatabaseStatusRowExists; }
 - (void)didInit { } // For subclasses to override
 
-+ (NSArray *)allLoadedInstances
-{
-    __block NSArray *outArray = nil;
-    fcm_onMainQueue(^{
-        NSMapTable *classCache = g_instances ? g_instances[self] : nil;
-        outArray = classCache.objectEnumerator.allObjects;
-    });
-    return outArray ?: @[];
-}
++ (NSArray *)allLoadedInstances { return fcm_loadedInstancesOfClass(self); }
 
 + (instancetype)instanceWithPrimaryKey:(id)primaryKeyValue { return [self instanceWithPrimaryKey:primaryKeyValue databaseRowValues:nil createIfNonexistent:YES]; }
 + (instancetype)instanceWithPrimaryKey:(id)primaryKeyValue createIfNonexistent:(BOOL)create { return [self instanceWithPrimaryKey:primaryKeyValue databaseRowValues:nil createIfNonexistent:create]; }
@@ -207,21 +797,64 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     primaryKeyValue = [self normalizedPrimaryKeyValue:primaryKeyValue];
     if (! primaryKeyValue || primaryKeyValue == NSNull.null) return (create ? [self new] : nil);
     
-    __block FCModel *instance = nil;
-    fcm_onMainQueue(^{
-        if (! g_instances) g_instances = [NSMutableDictionary dictionary];
-        NSMapTable *classCache = g_instances[self];
-        if (! classCache) classCache = g_instances[(id) self] = [NSMapTable strongToWeakObjectsMapTable];
-        instance = [classCache objectForKey:primaryKeyValue];
-
-        if (! instance) {
-            instance = fieldValues ? [[self alloc] initWithFieldValues:fieldValues existsInDatabaseAlready:YES] : [self instanceFromDatabaseWithPrimaryKey:primaryKeyValue];
-            if (! instance && create) instance = [[self alloc] initWithFieldValues:@{ g_primaryKeyFieldName[self] : primaryKeyValue } existsInDatabaseAlready:NO];
-            if (instance) [classCache setObject:instance forKey:primaryKeyValue];
+    FCModel *instance = fcm_loadedInstance(self, primaryKeyValue);
+    if (instance) return instance;
+
+    if (! fieldValues) {
+        NSUInteger readWriteCount = g_database.writeCount;
+        instance = [self instanceFromDatabaseWithPrimaryKey:primaryKeyValue];
+        if (instance) instance = [self registerInstance:instance primaryKey:primaryKeyValue readAtWriteCount:readWriteCount];
+        if (instance) return instance;
+    }
+
+    instance = fieldValues ? [[self alloc] initWithFieldValues:fieldValues existsInDatabaseAlready:YES] : nil;
+    if (! instance && create) instance = [[self alloc] initWithFieldValues:@{ g_primaryKeyFieldName[self] : primaryKeyValue } existsInDatabaseAlready:NO];
+    return instance ? fcm_registerLoadedInstance(self, primaryKeyValue, instance) : nil;
+}
+
+// Like instanceWithPrimaryKey:databaseRowValues:createIfNonexistent:NO, but only hydrates a new instance from the row if
+//  that primary key isn't already loaded
++ (instancetype)instanceFromCurrentRowOfHydrator:(FCModelRowHydrator *)hydrator registerInstance:(BOOL)registerInstance
+{
+    id primaryKeyValue = [self normalizedPrimaryKeyValue:hydrator.primaryKeyValue];
+    if (! primaryKeyValue) return nil;
+    
+    FCModel *instance = fcm_loadedInstance(self, primaryKeyValue);
+    if (instance) return instance;
+    
+    instance = [[self alloc] initWithCurrentRowOfHydrator:hydrator];
+    return registerInstance ? [self registerInstance:instance primaryKey:primaryKeyValue readAtWriteCount:g_database.readerWriteCount] : instance;
+}
+
+// For instances read from a concurrent reader's snapshot when g_database.writeCount was readWriteCount. A write that
+//  committed after the snapshot began reloads the loaded instances it changed, but can't have seen this one if it ran
+//  before registration. Registering before checking the count means any later write will see it; if a write already
+//  committed, the instance is re-read on the writer, and nil is returned if its row has since been deleted.
++ (instancetype)registerInstance:(FCModel *)instance primaryKey:(id)primaryKeyValue readAtWriteCount:(NSUInteger)readWriteCount
+{
+    FCModel *registeredInstance = fcm_registerLoadedInstance(self, primaryKeyValue, instance);
+    if (registeredInstance != instance || readWriteCount == g_database.writeCount) return registeredInstance;
+
+    __block BOOL rowExists = NO;
+    fcm_onDatabaseQueue(^{
+        [g_database inDatabase:^(FMDatabase *db) {
+            NSString *expandedQuery = ((FCModelClassSQL *) g_classSQL[self]).reloadByPrimaryKey;
+            queryProfileStart(expandedQuery);
+            FMResultSet *s = [db executeQuery:expandedQuery, primaryKeyValue];
+            if (! s || db.lastErrorCode) { [self queryFailedInDatabase:db]; return; }
+            NSError *error = nil;
+            if ( (rowExists = [s nextWithError:&error]) ) [instance updateWithDatabaseRow:s.resultDictionary];
+            [s close];
+            queryProfileEnd();
+            if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
+        }];
+
+        if (! rowExists) {
+            instance->_inDatabaseStatus = FCModelInDatabaseStatusDeleted;
+            fcm_unregisterLoadedInstance(self, primaryKeyValue);
         }
     });
-
-    return instance;
+    return rowExists ? instance : nil;
 }
 
 - (instancetype)initWithPrimaryKey:(id)primaryKeyValue { return [self.class instanceWithPrimaryKey:primaryKeyValue]; }
@@ -231,13 +864,13 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 + (instancetype)instanceFromDatabaseWithPrimaryKey:(id)key
 {
     __block FCModel *model = NULL;
-    [g_database inDatabase:^(FMDatabase *db) {
-        NSString *expandedQuery = [self expandQuery:@"SELECT * FROM \"$T\" WHERE \"$PK\"=?"];
+    [g_database inReadOnlyDatabase:^(FMDatabase *db) {
+        NSString *expandedQuery = ((FCModelClassSQL *) g_classSQL[self]).selectByPrimaryKey;
         queryProfileStart(expandedQuery);
         FMResultSet *s = [db executeQuery:expandedQuery, key];
         if (! s || db.lastErrorCode) { [self queryFailedInDatabase:db]; return; }
         NSError *error = nil;
-        if ([s nextWithError:&error]) model = [[self alloc] initWithFieldValues:s.resultDictionary existsInDatabaseAlready:YES];
+        if ([s nextWithError:&error]) model = [[self alloc] initWithCurrentRowOfHydrator:[[FCModelRowHydrator alloc] initWithModelClass:self resultSet:s]];
         [s close];
         queryProfileEnd();
         if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
@@ -249,24 +882,16 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 - (BOOL)reload
 {
     __block BOOL success = NO;
-    fcm_onMainQueue(^{
+    fcm_onDatabaseQueue(^{
         [g_database inDatabase:^(FMDatabase *db) {
             if (self.isDeleted) return;
             
-            NSString *expandedQuery = [self.class expandQuery:@"SELECT * FROM \"$T\" WHERE \"$PK\"=? -- reload"];
+            NSString *expandedQuery = ((FCModelClassSQL *) g_classSQL[self.class]).reloadByPrimaryKey;
             queryProfileStart(expandedQuery);
             FMResultSet *s = [db executeQuery:expandedQuery, self.primaryKey];
             if (! s || db.lastErrorCode) { [self.class queryFailedInDatabase:db]; return; }
             NSError *error = nil;
-            if ([s nextWithError:&error]) {
-                [self observableObjectPropertiesWillChange];
-                [g_fieldInfo[self.class] enumerateKeysAndObjectsUsingBlock:^(NSString *key, id obj, BOOL *stop) {
-                    id suppliedValue = s.resultDictionary[key];
-                    if (suppliedValue) [self setValue:(suppliedValue == NSNull.null ? nil : suppliedValue) forKey:key];
-                }];
-
-                self._rowValuesInDatabase = s.resultDictionary;
-            }
+            if ([s nextWithError:&error]) [self updateWithDatabaseRow:s.resultDictionary];
             [s close];
             queryProfileEnd();
             if (error && error.code != SQLITE_OK) [self.class queryFailedInDatabase:db];
@@ -275,10 +900,55 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     return success;
 }
 
+- (void)updateWithDatabaseRow:(NSDictionary *)rowValues
+{
+    [self observableObjectPropertiesWillChange];
+    [g_fieldInfo[self.class] enumerateKeysAndObjectsUsingBlock:^(NSString *key, id obj, BOOL *stop) {
+        id suppliedValue = rowValues[key];
+        if (suppliedValue) [self setValue:(suppliedValue == NSNull.null ? nil : suppliedValue) forKey:key];
+    }];
+
+    [self resetDatabaseValuesWithRow:rowValues];
+}
+
+// After an arbitrary write: rowIDs are those the update hook saw change (NSNull if unknown). Only loaded instances of
+//  those rows are refreshed, from as few queries as the parameter limit allows, instead of reloading each loaded instance.
++ (void)reloadLoadedInstancesWithAffectedRowIDs:(id)rowIDs
+{
+    NSArray *loadedInstances = fcm_loadedInstancesOfClass(self);
+    if (! loadedInstances.count || ! rowIDs) return;
+    
+    // Select by rowid if that's the smaller list, otherwise by the loaded instances' keys
+    NSString *column;
+    NSArray *values;
+    if (rowIDs != NSNull.null && ((NSSet *) rowIDs).count <= loadedInstances.count) {
+        column = @"rowid";
+        values = ((NSSet *) rowIDs).allObjects;
+    } else {
+        column = @"\"$PK\"";
+        values = [loadedInstances valueForKey:@"primaryKey"];
+    }
+    
+    NSString *pkName = g_primaryKeyFieldName[self];
+    NSUInteger chunkSize = (NSUInteger) fcm_maxQueryParameterCount();
+    for (NSUInteger offset = 0; offset < values.count; offset += chunkSize) {
+        NSArray *chunk = [values subarrayWithRange:NSMakeRange(offset, MIN(chunkSize, values.count - offset))];
+        NSString *query = [NSString stringWithFormat:
+            @"SELECT * FROM \"$T\" WHERE %@ IN (%@)",
+            column,
+            [[@"" stringByPaddingToLength:(chunk.count * 2) withString:@"?," startingAtIndex:0] substringToIndex:(chunk.count * 2 - 1)]
+        ];
+        [self _enumerateResultDictionariesFromQuery:query withVAList:NULL arguments:chunk usingBlock:^(NSDictionary *row, BOOL *stop) {
+            FCModel *instance = fcm_loadedInstance(self, [self normalizedPrimaryKeyValue:row[pkName]]);
+            if (instance && instance->_inDatabaseStatus == FCModelInDatabaseStatusRowExists) [instance updateWithDatabaseRow:row];
+        }];
+    }
+}
+
 - (BOOL)save:(void (^)(void))modificiationsBlock
 {
     __block BOOL success = NO;
-    fcm_onMainQueue(^{
+    fcm_onDatabaseQueue(^{
         [g_database inDatabase:^(FMDatabase *db) {
             if (self.isDeleted) return;
             if (modificiationsBlock) {
@@ -291,6 +961,16 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     return success;
 }
 
+- (void)saveAsync:(void (^)(void))modificiationsBlock completion:(void (^)(BOOL success))completion { [self saveAsync:modificiationsBlock completionQueue:nil completion:completion]; }
+- (void)saveAsync:(void (^)(void))modificiationsBlock completionQueue:(dispatch_queue_t)completionQueue completion:(void (^)(BOOL success))completion
+{
+    [self.class performAsyncReadOnly:NO block:^id{
+        return @([self save:modificiationsBlock]);
+    } completionQueue:completionQueue completion:^(NSNumber *success) {
+        if (completion) completion(success.boolValue);
+    }];
+}
+
 #pragma mark - Mapping properties to database fields
 
 + (NSArray *)databaseFieldNames     { return checkForOpenDatabaseFatal(NO) ? [g_fieldInfo[self] allKeys] : nil; }
@@ -312,7 +992,7 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 + (NSArray *)cachedInstancesWhere:(NSString *)queryAfterWHERE arguments:(NSArray *)arguments ignoreFieldsForInvalidation:(NSSet *)ignoredFields
 {
     if (! checkForOpenDatabaseFatal(NO)) return nil;
-    return [FCModelLiveResultArray arrayWithModelClass:self queryAfterWHERE:queryAfterWHERE arguments:arguments ignoreFieldsForInvalidation:nil].allObjects;
+    return [FCModelLiveResultArray arrayWithModelClass:self queryAfterWHERE:queryAfterWHERE arguments:arguments ignoreFieldsForInvalidation:ignoredFields].allObjects;
 }
 
 + (id)cachedObjectWithIdentifier:(id)identifier generator:(id (^)(void))generatorBlock
@@ -326,88 +1006,143 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     return [FCModelCachedObject objectWithModelClass:self cacheIdentifier:identifier ignoreFieldsForInvalidation:ignoredFields generator:generatorBlock].value;
 }
 
++ (id)cachedObjectWithIdentifier:(id)identifier ignoreFieldsForInvalidation:(NSSet *)ignoredFields cost:(NSUInteger)cost generator:(id (^)(void))generatorBlock
+{
+    if (! checkForOpenDatabaseFatal(NO)) return nil;
+    return [FCModelCachedObject objectWithModelClass:self cacheIdentifier:identifier ignoreFieldsForInvalidation:ignoredFields cost:cost generator:generatorBlock].value;
+}
+
 + (void)_executeUpdateQuery:(NSString *)query withVAList:(va_list)va_args arguments:(NSArray *)array_args
 {
     checkForOpenDatabaseFatal(YES);
 
-    fcm_onMainQueue(^{
+    fcm_onDatabaseQueue(^{
+        [self flushGroupCommit];
         __block NSDictionary *changedFieldsToNotify = nil;
+        __block NSDictionary *keyChangesToNotify = nil;
+        __block NSDictionary *affectedRowIDsByClass = nil;
         [g_database inDatabase:^(FMDatabase *db) {
             BOOL mustQueueNotificationsLocally = ! g_database.isQueuingNotifications;
-            if (mustQueueNotificationsLocally) g_database.isQueuingNotifications = YES;
+            if (mustQueueNotificationsLocally) {
+                g_database.isQueuingNotifications = YES;
+                g_database.isRecordingAffectedRowIDs = YES;
+            }
             
             NSString *expandedQuery = [self expandQuery:query];
             queryProfileStart(expandedQuery);
             BOOL success = va_args ? [db executeUpdate:expandedQuery withVAList:va_args] : [db executeUpdate:expandedQuery withArgumentsInArray:array_args];
             queryProfileEnd();
-            if (! success || db.lastErrorCode) [self queryFailedInDatabase:db];
+            if (mustQueueNotificationsLocally) g_database.isRecordingAffectedRowIDs = NO;
+            if (! success || db.lastErrorCode) {
+                [g_database.affectedRowIDsByClass removeAllObjects];
+                [self queryFailedInDatabase:db];
+            }
 
             if (mustQueueNotificationsLocally) {
                 g_database.isQueuingNotifications = NO;
                 changedFieldsToNotify = [g_database.enqueuedChangedFieldsByClass copy];
+                keyChangesToNotify = [g_database.enqueuedKeyChangesByClass copy];
                 [g_database.enqueuedChangedFieldsByClass removeAllObjects];
+                [g_database.enqueuedKeyChangesByClass removeAllObjects];
+                affectedRowIDsByClass = [g_database.affectedRowIDsByClass copy];
+                [g_database.affectedRowIDsByClass removeAllObjects];
             }
         }];
     
         // Send notifications
         if (changedFieldsToNotify) {
-            [changedFieldsToNotify enumerateKeysAndObjectsUsingBlock:^(Class class, NSDictionary *changedFields, BOOL *stop) {
-                [NSNotificationCenter.defaultCenter postNotificationName:FCModelWillSendChangeNotification object:class userInfo:@{ FCModelChangedFieldsKey : changedFields }];
-
-                NSMapTable *classCache = g_instances[class];
-                if (classCache) {
-                    for (FCModel *m in classCache.objectEnumerator.allObjects) [m reload];
-                }
-            }];
-            [changedFieldsToNotify enumerateKeysAndObjectsUsingBlock:^(Class class, NSDictionary *changedFields, BOOL *stop) {
-                [NSNotificationCenter.defaultCenter postNotificationName:FCModelChangeNotification object:class userInfo:@{ FCModelChangedFieldsKey : changedFields }];
-            }];
+            fcm_postQueuedChangeNotifications(changedFieldsToNotify, keyChangesToNotify, ^(Class class) {
+                [class reloadLoadedInstancesWithAffectedRowIDs:(affectedRowIDsByClass[class] ?: NSNull.null)];
+            });
         }
     });
 }
 + (void)executeUpdateQuery:(NSString *)query arguments:(NSArray *)args { [self _executeUpdateQuery:query withVAList:NULL arguments:args]; }
 + (void)executeUpdateQuery:(NSString *)query, ... { va_list args; va_start(args, query); [self _executeUpdateQuery:query withVAList:args arguments:nil]; va_end(args); }
 
-+ (id)_instancesWhere:(NSString *)query argsArray:(NSArray *)argsArray orVAList:(va_list)va_args onlyFirst:(BOOL)onlyFirst
+// Steps through a result set, calling rowBlock with an autorelease pool drained every batch of rows. Returns NO on error.
+static const NSUInteger FCModelEnumerationBatchSize = 256;
+static BOOL fcm_enumerateResultSet(FMResultSet *s, void (^rowBlock)(BOOL *stop))
 {
-    if (! checkForOpenDatabaseFatal(NO)) return nil;
-    NSMutableArray *instances = onlyFirst ? nil : [NSMutableArray array];
-    __block FCModel *instance = nil;
-
-    fcm_onMainQueue(^{
-        [g_database inDatabase:^(FMDatabase *db) {
-            NSString *pkName = g_primaryKeyFieldName[self];
-            NSString *expandedQuery = query ? [self expandQuery:[@"SELECT * FROM \"$T\" WHERE " stringByAppendingString:query]] : [self expandQuery:@"SELECT * FROM \"$T\""];
-            queryProfileStart(expandedQuery);
-            FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:argsArray];
-            if (! s || db.lastErrorCode) [self queryFailedInDatabase:db];
-
-            NSError *error = nil;
-            while ([s nextWithError:&error] && (! error || error.code == SQLITE_OK)) {
-                NSDictionary *rowDictionary = s.resultDictionary;
-                instance = [self instanceWithPrimaryKey:rowDictionary[pkName] databaseRowValues:rowDictionary createIfNonexistent:NO];
-                if (onlyFirst) break;
-                [instances addObject:instance];
+    BOOL stop = NO, finished = NO, failed = NO;
+    while (! stop && ! finished) {
+        @autoreleasepool {
+            for (NSUInteger i = 0; i < FCModelEnumerationBatchSize && ! stop; i++) {
+                NSError *error = nil;
+                if (! [s nextWithError:&error] || (error && error.code != SQLITE_OK)) {
+                    failed = (error && error.code != SQLITE_OK);
+                    finished = YES;
+                    break;
+                }
+                rowBlock(&stop);
             }
-            [s close];
-            queryProfileEnd();
-            if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
-        }];
-    });
-    
-    return onlyFirst ? instance : instances;
+        }
+    }
+    return ! failed;
 }
 
-+ (NSArray *)allInstances { return [self _instancesWhere:nil argsArray:nil orVAList:NULL onlyFirst:NO]; }
-
-+ (instancetype)firstInstanceWhere:(NSString *)query arguments:(NSArray *)args { return [self _instancesWhere:query argsArray:args orVAList:NULL onlyFirst:YES]; }
-+ (instancetype)firstInstanceWhere:(NSString *)query, ...
++ (void)_enumerateInstancesWhere:(NSString *)query argsArray:(NSArray *)argsArray orVAList:(va_list)va_args options:(FCModelEnumerationOptions)options usingBlock:(void (^)(id instance, BOOL *stop))block
 {
-    va_list args;
-    va_start(args, query);
-    id instance = [self _instancesWhere:query argsArray:nil orVAList:args onlyFirst:YES];
-    va_end(args);
-    return instance;
+    NSString *fullQuery = query ? [@"SELECT * FROM \"$T\" WHERE " stringByAppendingString:query] : @"SELECT * FROM \"$T\"";
+    [self _enumerateInstancesFromQuery:fullQuery argsArray:argsArray orVAList:va_args options:options usingBlock:block];
+}
+
+// query must select only this class's table columns
++ (void)_enumerateInstancesFromQuery:(NSString *)query argsArray:(NSArray *)argsArray orVAList:(va_list)va_args options:(FCModelEnumerationOptions)options usingBlock:(void (^)(id instance, BOOL *stop))block
+{
+    BOOL registerInstances = ! (options & FCModelEnumerationOptionDoNotRegisterInstances);
+    [g_database inReadOnlyDatabase:^(FMDatabase *db) {
+        NSString *expandedQuery = [self expandQuery:query];
+        queryProfileStart(expandedQuery);
+        FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:argsArray];
+        if (! s || db.lastErrorCode) { [self queryFailedInDatabase:db]; return; }
+
+        FCModelRowHydrator *hydrator = [[FCModelRowHydrator alloc] initWithModelClass:self resultSet:s];
+        BOOL success = fcm_enumerateResultSet(s, ^(BOOL *stop) {
+            FCModel *instance = [self instanceFromCurrentRowOfHydrator:hydrator registerInstance:registerInstances];
+            if (instance) block(instance, stop);
+        });
+        [s close];
+        queryProfileEnd();
+        if (! success) [self queryFailedInDatabase:db];
+    }];
+}
+
++ (id)_instancesWhere:(NSString *)query argsArray:(NSArray *)argsArray orVAList:(va_list)va_args onlyFirst:(BOOL)onlyFirst
+{
+    if (! checkForOpenDatabaseFatal(NO)) return nil;
+    NSMutableArray *instances = onlyFirst ? nil : [NSMutableArray array];
+    __block FCModel *firstInstance = nil;
+
+    [self _enumerateInstancesWhere:query argsArray:argsArray orVAList:va_args options:FCModelEnumerationOptionsNone usingBlock:^(id instance, BOOL *stop) {
+        if (onlyFirst) {
+            firstInstance = instance;
+            *stop = YES;
+        } else {
+            [instances addObject:instance];
+        }
+    }];
+    
+    return onlyFirst ? firstInstance : instances;
+}
+
++ (void)enumerateInstancesWhere:(NSString *)query arguments:(NSArray *)arguments usingBlock:(void (^)(id instance, BOOL *stop))block { [self enumerateInstancesWhere:query arguments:arguments options:FCModelEnumerationOptionsNone usingBlock:block]; }
++ (void)enumerateInstancesWhere:(NSString *)query arguments:(NSArray *)arguments options:(FCModelEnumerationOptions)options usingBlock:(void (^)(id instance, BOOL *stop))block
+{
+    if (! checkForOpenDatabaseFatal(NO)) return;
+    [self _enumerateInstancesWhere:query argsArray:arguments orVAList:NULL options:options usingBlock:block];
+}
+
++ (NSArray *)allInstances { return [self _instancesWhere:nil argsArray:nil orVAList:NULL onlyFirst:NO]; }
+
++ (instancetype)firstInstanceWhere:(NSString *)query arguments:(NSArray *)args { return [self _instancesWhere:query argsArray:args orVAList:NULL onlyFirst:YES]; }
++ (instancetype)firstInstanceWhere:(NSString *)query, ...
+{
+    va_list args;
+    va_start(args, query);
+    id instance = [self _instancesWhere:query argsArray:nil orVAList:args onlyFirst:YES];
+    va_end(args);
+    return instance;
 }
 
 + (NSArray *)instancesWhere:(NSString *)query arguments:(NSArray *)args { return [self _instancesWhere:query argsArray:args orVAList:NULL onlyFirst:NO]; }
@@ -446,22 +1181,20 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     if (! checkForOpenDatabaseFatal(NO)) return 0;
     
     __block NSUInteger count = 0;
-    fcm_onMainQueue(^{
-        [g_database inDatabase:^(FMDatabase *db) {
-            NSString *expandedQuery = [self expandQuery:(queryAfterWHERE ? [@"SELECT COUNT(*) FROM $T WHERE " stringByAppendingString:queryAfterWHERE] : @"SELECT COUNT(*) FROM $T")];
-            queryProfileStart(expandedQuery);
-            FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:args];
-            if (! s || db.lastErrorCode) [self queryFailedInDatabase:db];
-            NSError *error = nil;
-            if ([s nextWithError:&error]) {
-                NSNumber *value = [s objectForColumnIndex:0];
-                if (value) count = value.unsignedIntegerValue;
-            }
-            [s close];
-            queryProfileEnd();
-            if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
-        }];
-    });
+    [g_database inReadOnlyDatabase:^(FMDatabase *db) {
+        NSString *expandedQuery = [self expandQuery:(queryAfterWHERE ? [@"SELECT COUNT(*) FROM $T WHERE " stringByAppendingString:queryAfterWHERE] : @"SELECT COUNT(*) FROM $T")];
+        queryProfileStart(expandedQuery);
+        FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:args];
+        if (! s || db.lastErrorCode) [self queryFailedInDatabase:db];
+        NSError *error = nil;
+        if ([s nextWithError:&error]) {
+            NSNumber *value = [s objectForColumnIndex:0];
+            if (value) count = value.unsignedIntegerValue;
+        }
+        [s close];
+        queryProfileEnd();
+        if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
+    }];
     return count;
 }
 + (NSUInteger)numberOfInstancesWhere:(NSString *)query arguments:(NSArray *)args { return [self _numberOfInstancesWhere:query withVAList:NULL arguments:args]; };
@@ -473,19 +1206,17 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     if (! checkForOpenDatabaseFatal(NO)) return nil;
     
     NSMutableArray *columnArray = [NSMutableArray array];
-    fcm_onMainQueue(^{
-        [g_database inDatabase:^(FMDatabase *db) {
-            NSString *expandedQuery = [self expandQuery:query ?: @"SELECT * FROM \"$T\""];
-            queryProfileStart(expandedQuery);
-            FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:arguments];
-            if (! s || db.lastErrorCode) [self queryFailedInDatabase:db];
-            NSError *error = nil;
-            while ([s nextWithError:&error] && (! error || error.code == SQLITE_OK)) [columnArray addObject:[s objectForColumnIndex:0]];
-            [s close];
-            queryProfileEnd();
-            if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
-        }];
-    });
+    [g_database inReadOnlyDatabase:^(FMDatabase *db) {
+        NSString *expandedQuery = [self expandQuery:query ?: @"SELECT * FROM \"$T\""];
+        queryProfileStart(expandedQuery);
+        FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:arguments];
+        if (! s || db.lastErrorCode) [self queryFailedInDatabase:db];
+        NSError *error = nil;
+        while ([s nextWithError:&error] && (! error || error.code == SQLITE_OK)) [columnArray addObject:[s objectForColumnIndex:0]];
+        [s close];
+        queryProfileEnd();
+        if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
+    }];
     return columnArray;
 }
 + (NSArray *)firstColumnArrayFromQuery:(NSString *)query arguments:(NSArray *)arguments { return [self _firstColumnArrayFromQuery:query withVAList:NULL arguments:arguments]; }
@@ -496,21 +1227,34 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     if (! checkForOpenDatabaseFatal(NO)) return nil;
 
     NSMutableArray *rows = [NSMutableArray array];
-    fcm_onMainQueue(^{
-        [g_database inDatabase:^(FMDatabase *db) {
-            NSString *expandedQuery = [self expandQuery:query ?: @"SELECT * FROM \"$T\""];
-            queryProfileStart(expandedQuery);
-            FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:arguments];
-            if (! s || db.lastErrorCode) [self queryFailedInDatabase:db];
-            NSError *error = nil;
-            while ([s nextWithError:&error] && (! error || error.code == SQLITE_OK)) [rows addObject:s.resultDictionary];
-            [s close];
-            queryProfileEnd();
-            if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
-        }];
-    });
+    [self _enumerateResultDictionariesFromQuery:query withVAList:va_args arguments:arguments usingBlock:^(NSDictionary *row, BOOL *stop) {
+        [rows addObject:row];
+    }];
     return rows;
 }
+
++ (void)_enumerateResultDictionariesFromQuery:(NSString *)query withVAList:(va_list)va_args arguments:(NSArray *)arguments usingBlock:(void (^)(NSDictionary *row, BOOL *stop))block
+{
+    [g_database inReadOnlyDatabase:^(FMDatabase *db) {
+        NSString *expandedQuery = [self expandQuery:query ?: @"SELECT * FROM \"$T\""];
+        queryProfileStart(expandedQuery);
+        FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:arguments];
+        if (! s || db.lastErrorCode) { [self queryFailedInDatabase:db]; return; }
+        BOOL success = fcm_enumerateResultSet(s, ^(BOOL *stop) {
+            NSDictionary *row = s.resultDictionary;
+            if (row) block(row, stop);
+        });
+        [s close];
+        queryProfileEnd();
+        if (! success) [self queryFailedInDatabase:db];
+    }];
+}
+
++ (void)enumerateResultDictionariesFromQuery:(NSString *)query arguments:(NSArray *)arguments usingBlock:(void (^)(NSDictionary *row, BOOL *stop))block
+{
+    if (! checkForOpenDatabaseFatal(NO)) return;
+    [self _enumerateResultDictionariesFromQuery:query withVAList:NULL arguments:arguments usingBlock:block];
+}
 + (NSArray *)resultDictionariesFromQuery:(NSString *)query arguments:(NSArray *)arguments { return [self _resultDictionariesFromQuery:query withVAList:NULL arguments:arguments]; }
 + (NSArray *)resultDictionariesFromQuery:(NSString *)query, ... { va_list args; va_start(args, query); NSArray *r = [self _resultDictionariesFromQuery:query withVAList:args arguments:nil]; va_end(args); return r; }
 
@@ -519,19 +1263,17 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     if (! checkForOpenDatabaseFatal(NO)) return nil;
 
     __block id firstValue = nil;
-    fcm_onMainQueue(^{
-        [g_database inDatabase:^(FMDatabase *db) {
-            NSString *expandedQuery = [self expandQuery:query];
-            queryProfileStart(expandedQuery);
-            FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:arguments];
-            if (! s || db.lastErrorCode) [self queryFailedInDatabase:db];
-            NSError *error = nil;
-            if ([s nextWithError:&error] && (! error || error.code == SQLITE_OK)) firstValue = [[s objectForColumnIndex:0] copy];
-            [s close];
-            queryProfileEnd();
-            if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
-        }];
-    });
+    [g_database inReadOnlyDatabase:^(FMDatabase *db) {
+        NSString *expandedQuery = [self expandQuery:query];
+        queryProfileStart(expandedQuery);
+        FMResultSet *s = va_args ? [db executeQuery:expandedQuery withVAList:va_args] : [db executeQuery:expandedQuery withArgumentsInArray:arguments];
+        if (! s || db.lastErrorCode) [self queryFailedInDatabase:db];
+        NSError *error = nil;
+        if ([s nextWithError:&error] && (! error || error.code == SQLITE_OK)) firstValue = [[s objectForColumnIndex:0] copy];
+        [s close];
+        queryProfileEnd();
+        if (error && error.code != SQLITE_OK) [self queryFailedInDatabase:db];
+    }];
     return firstValue;
 }
 + (id)firstValueFromQuery:(NSString *)query arguments:(NSArray *)arguments { return [self _firstValueFromQuery:query withVAList:NULL arguments:arguments]; }
@@ -547,6 +1289,26 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     return [self _batchedWherePrimaryKeyValueIn:primaryKeyValues andWhere:additionalWhereClause arguments:arguments countOnly:NULL setClauseForUpdate:nil setClauseArguments:nil];
 }
 
++ (NSArray *)instancesWherePrimaryKeyValueIn:(NSArray *)primaryKeyValues andWhere:(NSString *)additionalWhereClause arguments:(NSArray *)arguments options:(FCModelPrimaryKeyLookupOptions)options
+{
+    if (! (options & FCModelPrimaryKeyLookupOptionPreserveKeyOrder)) return [self instancesWherePrimaryKeyValueIn:primaryKeyValues andWhere:additionalWhereClause arguments:arguments];
+    if (! checkForOpenDatabaseFatal(NO)) return nil;
+    
+    NSArray *instances = nil;
+    if ([self _joinedWherePrimaryKeyValueIn:primaryKeyValues andWhere:additionalWhereClause arguments:arguments orderedByKeys:YES instances:&instances countOnly:NULL]) return instances;
+    
+    // No JSON support or unencodable keys: fetch in chunks, then order by each key's first position in the input
+    NSMutableDictionary *positionsByKey = [NSMutableDictionary dictionaryWithCapacity:primaryKeyValues.count];
+    [primaryKeyValues enumerateObjectsUsingBlock:^(id pkValue, NSUInteger idx, BOOL *stop) {
+        id normalizedKeyValue = [self normalizedPrimaryKeyValue:pkValue];
+        if (normalizedKeyValue && ! positionsByKey[normalizedKeyValue]) positionsByKey[normalizedKeyValue] = @(idx);
+    }];
+    instances = [self _batchedWherePrimaryKeyValueIn:primaryKeyValues andWhere:additionalWhereClause arguments:arguments countOnly:NULL setClauseForUpdate:nil setClauseArguments:nil];
+    return [instances sortedArrayUsingComparator:^NSComparisonResult(FCModel *a, FCModel *b) {
+        return [positionsByKey[a.primaryKey] compare:positionsByKey[b.primaryKey]];
+    }];
+}
+
 + (NSUInteger)numberOfInstancesWherePrimaryKeyValueIn:(NSArray * _Nullable)primaryKeyValues andWhere:(NSString * _Nullable)additionalWhereClause arguments:(NSArray * _Nullable)arguments
 {
     NSUInteger count = 0;
@@ -559,6 +1321,176 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     [self _batchedWherePrimaryKeyValueIn:primaryKeyValues andWhere:additionalWhereClause arguments:additionalWhereArguments countOnly:NULL setClauseForUpdate:setClause setClauseArguments:setArguments];
 }
 
+static int fcm_maxQueryParameterCount(void)
+{
+    static int maxParameterCount = 0;
+    if (! maxParameterCount) {
+        [g_database inReadOnlyDatabase:^(FMDatabase *db) {
+            maxParameterCount = sqlite3_limit(db.sqliteHandle, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+        }];
+    }
+    return maxParameterCount;
+}
+
+static BOOL fcm_databaseSupportsJSON(void)
+{
+    static int supported = -1;
+    if (supported < 0) {
+        [g_database inReadOnlyDatabase:^(FMDatabase *db) {
+            // Prepared directly so a missing json_each() isn't reported as a query failure
+            sqlite3_stmt *statement = NULL;
+            supported = (SQLITE_OK == sqlite3_prepare_v2(db.sqliteHandle, "SELECT value FROM json_each('[]')", -1, &statement, NULL));
+            sqlite3_finalize(statement);
+        }];
+    }
+    return supported > 0;
+}
+
+typedef struct {
+    const char *tableName;
+    __unsafe_unretained NSMutableSet *columnNames;
+} FCModelReadColumnsContext;
+
+static int fcm_recordReadColumn(void *context, int action, const char *table, const char *column, const char *database, const char *triggerOrView)
+{
+    FCModelReadColumnsContext *readColumns = (FCModelReadColumnsContext *) context;
+    if (action == SQLITE_READ && table && column && column[0] && 0 == strcasecmp(table, readColumns->tableName)) {
+        [readColumns->columnNames addObject:[NSString stringWithUTF8String:column]];
+    }
+    return SQLITE_OK;
+}
+
+// The fields of this class that a query after WHERE (including any ORDER BY or LIMIT) reads to choose and order its
+//  rows, found by preparing it with an authorizer on the statement-analysis connection. Returns nil if the query can't
+//  be prepared.
++ (NSSet *)fieldNamesReadByQueryAfterWHERE:(NSString *)queryAfterWHERE
+{
+    if (! queryAfterWHERE) return [NSSet set];
+    
+    NSString *expandedQuery = [self expandQuery:[@"SELECT 1 FROM \"$T\" WHERE " stringByAppendingString:queryAfterWHERE]];
+    NSMutableSet *columnNames = [NSMutableSet set];
+    __block BOOL prepared = NO;
+    [g_database inStatementAnalysisDatabase:^(sqlite3 *db) {
+        FCModelReadColumnsContext context = { self.tableName.UTF8String, columnNames };
+        sqlite3_set_authorizer(db, fcm_recordReadColumn, &context);
+        sqlite3_stmt *statement = NULL;
+        prepared = (SQLITE_OK == sqlite3_prepare_v2(db, expandedQuery.UTF8String, -1, &statement, NULL));
+        sqlite3_finalize(statement);
+        sqlite3_set_authorizer(db, NULL, NULL);
+    }];
+    if (! prepared) return nil;
+
+    NSMutableSet *fieldNames = [NSMutableSet setWithCapacity:columnNames.count];
+    for (NSString *fieldName in self.databaseFieldNames) {
+        for (NSString *columnName in columnNames) {
+            if (NSOrderedSame == [fieldName caseInsensitiveCompare:columnName]) { [fieldNames addObject:fieldName]; break; }
+        }
+    }
+    return fieldNames;
+}
+
+// Splits a query after WHERE into its conditions and an ORDER BY on plain fields whose values sort in memory the way
+//  SQLite sorts them (numbers, dates, and text without custom collations), returned as NSSortDescriptors. Returns NO
+//  for anything else, such as LIMIT, GROUP BY, or sorting by expressions.
++ (BOOL)splitQueryAfterWHERE:(NSString *)queryAfterWHERE conditions:(out NSString **)outConditions sortDescriptors:(out NSArray **)outSortDescriptors
+{
+    static NSRegularExpression *orderByRegex, *unsupportedRegex;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        orderByRegex = [NSRegularExpression regularExpressionWithPattern:@"\\s+ORDER\\s+BY\\s+" options:NSRegularExpressionCaseInsensitive error:NULL];
+        unsupportedRegex = [NSRegularExpression regularExpressionWithPattern:@"\\b(LIMIT|OFFSET|GROUP\\s+BY|HAVING|UNION|INTERSECT|EXCEPT)\\b" options:NSRegularExpressionCaseInsensitive error:NULL];
+    });
+
+    NSString *query = [self expandQuery:queryAfterWHERE ?: @"1"];
+    NSRange queryRange = NSMakeRange(0, query.length);
+    if ([unsupportedRegex firstMatchInString:query options:0 range:queryRange]) return NO;
+    NSArray *orderByMatches = [orderByRegex matchesInString:query options:0 range:queryRange];
+    if (orderByMatches.count > 1) return NO;
+
+    NSString *conditions = query;
+    NSMutableArray *sortDescriptors = [NSMutableArray array];
+    if (orderByMatches.count) {
+        NSRange orderByRange = ((NSTextCheckingResult *) orderByMatches[0]).range;
+        conditions = [query substringToIndex:orderByRange.location];
+        
+        NSCharacterSet *identifierQuotes = [NSCharacterSet characterSetWithCharactersInString:@"\"`[]"];
+        for (NSString *term in [[query substringFromIndex:NSMaxRange(orderByRange)] componentsSeparatedByString:@","]) {
+            NSMutableArray *words = [[term componentsSeparatedByCharactersInSet:NSCharacterSet.whitespaceAndNewlineCharacterSet] mutableCopy];
+            [words removeObject:@""];
+            if (words.count < 1 || words.count > 2) return NO;
+
+            BOOL ascending = YES;
+            if (words.count == 2) {
+                if ([words[1] caseInsensitiveCompare:@"DESC"] == NSOrderedSame) ascending = NO;
+                else if ([words[1] caseInsensitiveCompare:@"ASC"] != NSOrderedSame) return NO;
+            }
+
+            NSString *columnName = [words[0] stringByTrimmingCharactersInSet:identifierQuotes], *sortFieldName = nil;
+            for (NSString *fieldName in self.databaseFieldNames) {
+                if (NSOrderedSame == [fieldName caseInsensitiveCompare:columnName]) { sortFieldName = fieldName; break; }
+            }
+            if (! sortFieldName) return NO;
+
+            FCModelFieldInfo *info = g_fieldInfo[self][sortFieldName];
+            Class propertyClass = info.propertyClass;
+            if (info.type == FCModelFieldTypeOther) return NO;
+            if (propertyClass && ! [propertyClass isSubclassOfClass:NSNumber.class] && ! [propertyClass isSubclassOfClass:NSDate.class]) {
+                if (! [propertyClass isSubclassOfClass:NSString.class] || info.type != FCModelFieldTypeText) return NO;
+
+                // In-memory string comparison only matches SQLite's default BINARY collation
+                NSString *tableSQL = [self firstValueFromQuery:@"SELECT sql FROM sqlite_master WHERE type = 'table' AND tbl_name = ? COLLATE NOCASE" arguments:@[ self.tableName ]];
+                if (! [tableSQL isKindOfClass:NSString.class] || [tableSQL rangeOfString:@"COLLATE" options:NSCaseInsensitiveSearch].location != NSNotFound) return NO;
+            }
+
+            [sortDescriptors addObject:[NSSortDescriptor sortDescriptorWithKey:sortFieldName ascending:ascending]];
+        }
+    }
+
+    if (outConditions) *outConditions = conditions;
+    if (outSortDescriptors) *outSortDescriptors = [sortDescriptors copy];
+    return YES;
+}
+
+// Binds the whole key list as one JSON array joined through json_each(), so any number of keys takes a single statement
+//  (with the same SQL every time) instead of one IN (...) list per parameter-limit chunk. Duplicate keys are ignored.
+//  Returns NO without querying if the keys can't be sent this way: no JSON support in SQLite, or keys that aren't
+//  JSON-encodable (such as NSData).
++ (BOOL)_joinedWherePrimaryKeyValueIn:(NSArray *)primaryKeyValues andWhere:(NSString *)additionalWhereClause arguments:(NSArray *)additionalWhereArguments orderedByKeys:(BOOL)orderedByKeys instances:(out NSArray **)outInstances countOnly:(out NSUInteger *)outCountOnly
+{
+    if (! fcm_databaseSupportsJSON()) return NO;
+    
+    NSMutableOrderedSet *normalizedKeyValues = [NSMutableOrderedSet orderedSetWithCapacity:primaryKeyValues.count];
+    for (id pkValue in primaryKeyValues) {
+        id normalizedKeyValue = [self normalizedPrimaryKeyValue:pkValue];
+        if (normalizedKeyValue) [normalizedKeyValues addObject:normalizedKeyValue];
+    }
+    NSArray *keyArray = normalizedKeyValues.array;
+    if (! [NSJSONSerialization isValidJSONObject:keyArray]) return NO;
+    NSData *keyJSONData = [NSJSONSerialization dataWithJSONObject:keyArray options:0 error:NULL];
+    if (! keyJSONData) return NO;
+    NSString *keyJSON = [[NSString alloc] initWithData:keyJSONData encoding:NSUTF8StringEncoding];
+    
+    // The keys' columns are renamed so they can't be confused with the table's in the additional WHERE clause
+    NSMutableString *query = [NSMutableString stringWithFormat:
+        @"SELECT %@ FROM (SELECT key AS fcm_position, value AS fcm_key FROM json_each(?)) AS fcm_keys JOIN \"$T\" ON \"$T\".\"$PK\" = fcm_keys.fcm_key",
+        outCountOnly ? @"COUNT(*)" : @"\"$T\".*"
+    ];
+    if (additionalWhereClause.length) [query appendFormat:@" WHERE (%@)", additionalWhereClause];
+    if (orderedByKeys && ! outCountOnly) [query appendString:@" ORDER BY fcm_keys.fcm_position"];
+    NSArray *arguments = additionalWhereArguments ? [@[ keyJSON ] arrayByAddingObjectsFromArray:additionalWhereArguments] : @[ keyJSON ];
+    
+    if (outCountOnly) {
+        *outCountOnly = [[self _firstValueFromQuery:query withVAList:NULL arguments:arguments] unsignedIntegerValue];
+    } else {
+        NSMutableArray *instances = [NSMutableArray arrayWithCapacity:keyArray.count];
+        [self _enumerateInstancesFromQuery:query argsArray:arguments orVAList:NULL options:FCModelEnumerationOptionsNone usingBlock:^(id instance, BOOL *stop) {
+            [instances addObject:instance];
+        }];
+        if (outInstances) *outInstances = instances;
+    }
+    return YES;
+}
+
 + (NSArray *)_batchedWherePrimaryKeyValueIn:(NSArray *)primaryKeyValues andWhere:(NSString *)additionalWhereClause arguments:(NSArray *)additionalWhereArguments countOnly:(out NSUInteger *)outCountOnly setClauseForUpdate:(NSString *)updateSetClause setClauseArguments:(NSArray *)setClauseArguments
 {
     if (outCountOnly) *outCountOnly = 0;
@@ -567,62 +1499,114 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     if (primaryKeyValues.count == 0) return @[];
     
     __block NSArray *allFoundInstances = nil;
-    fcm_onMainQueue(^{
-        static int maxParameterCount = 0;
-        if (! maxParameterCount) {
-            [g_database inDatabase:^(FMDatabase *db) {
-                maxParameterCount = sqlite3_limit(db.sqliteHandle, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
-            }];
-        }
-        
-        int primaryKeyCountLimitPerQuery = maxParameterCount - ((int) setClauseArguments.count + (int) additionalWhereArguments.count);
+    int primaryKeyCountLimitPerQuery = fcm_maxQueryParameterCount() - ((int) setClauseArguments.count + (int) additionalWhereArguments.count);
+    
+    // Key lists too big for one IN (...) are looked up in one joined query instead of many chunks, if possible
+    if (! updateSetClause.length && primaryKeyValues.count > primaryKeyCountLimitPerQuery) {
+        NSArray *joinedInstances = nil;
+        if ([self _joinedWherePrimaryKeyValueIn:primaryKeyValues andWhere:additionalWhereClause arguments:additionalWhereArguments orderedByKeys:NO instances:&joinedInstances countOnly:outCountOnly]) return joinedInstances;
+    }
 
-        NSMutableArray *valuesArray = [NSMutableArray arrayWithCapacity:MIN(primaryKeyValues.count, primaryKeyCountLimitPerQuery)];
-        NSMutableString *whereClause = [NSMutableString stringWithFormat:@"%@ IN (", g_primaryKeyFieldName[self]];
-        NSUInteger whereClauseLength = whereClause.length;
-        
-        void (^fetchChunk)(void) = ^{
-            if (valuesArray.count == 0) return;
-            [whereClause appendString:@")"];
-            if (additionalWhereClause.length) [whereClause appendFormat:@" AND (%@)", additionalWhereClause];
-            
-            if (updateSetClause && updateSetClause.length) {
-                NSArray *combinedArgs = [(setClauseArguments ?: @[]) arrayByAddingObjectsFromArray:(additionalWhereArguments ? [valuesArray arrayByAddingObjectsFromArray:additionalWhereArguments] : valuesArray)];
-                NSString *query = [NSString stringWithFormat:@"UPDATE $T SET %@ WHERE %@", updateSetClause, whereClause];
-                [self executeUpdateQuery:query arguments:combinedArgs];
-            } else if (outCountOnly) {
-                NSArray *combinedArgs = additionalWhereArguments ? [valuesArray arrayByAddingObjectsFromArray:additionalWhereArguments] : valuesArray;
-                *outCountOnly += [self _numberOfInstancesWhere:whereClause withVAList:NULL arguments:combinedArgs];
-            } else {
-                NSArray *combinedArgs = additionalWhereArguments ? [valuesArray arrayByAddingObjectsFromArray:additionalWhereArguments] : valuesArray;
-                NSArray *newInstancesThisChunk = [self _instancesWhere:whereClause argsArray:combinedArgs orVAList:NULL onlyFirst:NO];
-                allFoundInstances = allFoundInstances ? [allFoundInstances arrayByAddingObjectsFromArray:newInstancesThisChunk] : newInstancesThisChunk;
-            }
-            
-            // reset state for next chunk
-            [whereClause deleteCharactersInRange:NSMakeRange(whereClauseLength, whereClause.length - whereClauseLength)];
-            [valuesArray removeAllObjects];
-        };
+    NSMutableArray *valuesArray = [NSMutableArray arrayWithCapacity:MIN(primaryKeyValues.count, primaryKeyCountLimitPerQuery)];
+    NSMutableString *whereClause = [NSMutableString stringWithFormat:@"%@ IN (", g_primaryKeyFieldName[self]];
+    NSUInteger whereClauseLength = whereClause.length;
+    
+    void (^fetchChunk)(void) = ^{
+        if (valuesArray.count == 0) return;
+        [whereClause appendString:@")"];
+        if (additionalWhereClause.length) [whereClause appendFormat:@" AND (%@)", additionalWhereClause];
         
-        for (id pkValue in primaryKeyValues) {
-            [whereClause appendString:(valuesArray.count ? @",?" : @"?")];
-            [valuesArray addObject:pkValue];
-            if (valuesArray.count >= primaryKeyCountLimitPerQuery) fetchChunk();
+        if (updateSetClause && updateSetClause.length) {
+            NSArray *combinedArgs = [(setClauseArguments ?: @[]) arrayByAddingObjectsFromArray:(additionalWhereArguments ? [valuesArray arrayByAddingObjectsFromArray:additionalWhereArguments] : valuesArray)];
+            NSString *query = [NSString stringWithFormat:@"UPDATE $T SET %@ WHERE %@", updateSetClause, whereClause];
+            [self executeUpdateQuery:query arguments:combinedArgs];
+        } else if (outCountOnly) {
+            NSArray *combinedArgs = additionalWhereArguments ? [valuesArray arrayByAddingObjectsFromArray:additionalWhereArguments] : valuesArray;
+            *outCountOnly += [self _numberOfInstancesWhere:whereClause withVAList:NULL arguments:combinedArgs];
+        } else {
+            NSArray *combinedArgs = additionalWhereArguments ? [valuesArray arrayByAddingObjectsFromArray:additionalWhereArguments] : valuesArray;
+            NSArray *newInstancesThisChunk = [self _instancesWhere:whereClause argsArray:combinedArgs orVAList:NULL onlyFirst:NO];
+            allFoundInstances = allFoundInstances ? [allFoundInstances arrayByAddingObjectsFromArray:newInstancesThisChunk] : newInstancesThisChunk;
         }
-        fetchChunk();
-    });
+        
+        // reset state for next chunk
+        [whereClause deleteCharactersInRange:NSMakeRange(whereClauseLength, whereClause.length - whereClauseLength)];
+        [valuesArray removeAllObjects];
+    };
+    
+    for (id pkValue in primaryKeyValues) {
+        [whereClause appendString:(valuesArray.count ? @",?" : @"?")];
+        [valuesArray addObject:pkValue];
+        if (valuesArray.count >= primaryKeyCountLimitPerQuery) fetchChunk();
+    }
+    fetchChunk();
     return allFoundInstances;
 }
 
+#pragma mark - Asynchronous variants
+
++ (void)performAsyncReadOnly:(BOOL)readOnly block:(id (^)(void))block completionQueue:(dispatch_queue_t)completionQueue completion:(void (^)(id result))completion
+{
+    if (! checkForOpenDatabaseFatal(NO)) {
+        dispatch_async(completionQueue ?: dispatch_get_main_queue(), ^{ completion(nil); });
+        return;
+    }
+    
+    void (^work)(void) = ^{
+        id result = block();
+        dispatch_async(completionQueue ?: dispatch_get_main_queue(), ^{ completion(result); });
+    };
+
+    // SELECTs can go straight to a concurrent reader. Everything else waits its turn on the database queue.
+    if (readOnly && g_database.maxConcurrentReaders) dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), work);
+    else [g_database performAsync:work];
+}
+
++ (void)instancesWhere:(NSString *)query arguments:(NSArray *)args completion:(void (^)(NSArray *instances))completion { [self instancesWhere:query arguments:args completionQueue:nil completion:completion]; }
++ (void)instancesWhere:(NSString *)query arguments:(NSArray *)args completionQueue:(dispatch_queue_t)completionQueue completion:(void (^)(NSArray *instances))completion
+{
+    [self performAsyncReadOnly:YES block:^id{ return [self instancesWhere:query arguments:args]; } completionQueue:completionQueue completion:completion];
+}
+
++ (void)firstInstanceWhere:(NSString *)query arguments:(NSArray *)args completion:(void (^)(id instance))completion { [self firstInstanceWhere:query arguments:args completionQueue:nil completion:completion]; }
++ (void)firstInstanceWhere:(NSString *)query arguments:(NSArray *)args completionQueue:(dispatch_queue_t)completionQueue completion:(void (^)(id instance))completion
+{
+    [self performAsyncReadOnly:YES block:^id{ return [self firstInstanceWhere:query arguments:args]; } completionQueue:completionQueue completion:completion];
+}
+
++ (void)numberOfInstancesWhere:(NSString *)query arguments:(NSArray *)args completion:(void (^)(NSUInteger count))completion { [self numberOfInstancesWhere:query arguments:args completionQueue:nil completion:completion]; }
++ (void)numberOfInstancesWhere:(NSString *)query arguments:(NSArray *)args completionQueue:(dispatch_queue_t)completionQueue completion:(void (^)(NSUInteger count))completion
+{
+    [self performAsyncReadOnly:YES block:^id{
+        return @([self numberOfInstancesWhere:query arguments:args]);
+    } completionQueue:completionQueue completion:^(NSNumber *count) {
+        completion(count.unsignedIntegerValue);
+    }];
+}
+
++ (void)executeUpdateQuery:(NSString *)query arguments:(NSArray *)args completion:(void (^)(void))completion { [self executeUpdateQuery:query arguments:args completionQueue:nil completion:completion]; }
++ (void)executeUpdateQuery:(NSString *)query arguments:(NSArray *)args completionQueue:(dispatch_queue_t)completionQueue completion:(void (^)(void))completion
+{
+    [self performAsyncReadOnly:NO block:^id{
+        [self executeUpdateQuery:query arguments:args];
+        return nil;
+    } completionQueue:completionQueue completion:^(id result) {
+        if (completion) completion();
+    }];
+}
+
 + (void)setQueryFailedHandler:(void (^)(NSException *proposedException, int dbErrorCode, NSString *dbErrorMessage))handler
 {
     dbErrorHandler = handler;
 }
 
-+ (void)queryFailedInDatabase:(FMDatabase *)db
++ (void)queryFailedInDatabase:(FMDatabase *)db { [self queryFailedWithErrorCode:db.lastErrorCode message:db.lastErrorMessage]; }
+
++ (void)queryFailedWithErrorCode:(int)lastErrorCode message:(NSString *)lastErrorMessage
 {
-    int lastErrorCode = db.lastErrorCode;
-    NSString *lastErrorMessage = db.lastErrorMessage;
+    // Closing the database would tear down the reader pool while a reader is still checked out of it
+    if ([g_database performAfterReaderCheckIn:^{ [self queryFailedWithErrorCode:lastErrorCode message:lastErrorMessage]; }]) return;
+
     NSException *exception = [NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"Query failed with SQLite error %d: %@", lastErrorCode, lastErrorMessage] userInfo:nil];
 
     [FCModel closeDatabase];
@@ -648,15 +1632,80 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     return @(random);
 }
 
++ (FCModelPrimaryKeyGeneration)primaryKeyGeneration { return FCModelPrimaryKeyGenerationCheckDatabase; }
+
++ (id)generatedPrimaryKeyValueCheckingDatabase:(BOOL)checkDatabase
+{
+    BOOL sequential = (self.primaryKeyGeneration == FCModelPrimaryKeyGenerationSequential);
+    int attempts = 0;
+    while (YES) {
+        attempts++;
+        NSAssert1(attempts < 100, @"FCModel subclass %@ is not returning usable, unique values from primaryKeyValueForNewInstance", NSStringFromClass(self));
+        
+        id newKeyValue = sequential ? [self nextSequentialPrimaryKeyValue] : [self primaryKeyValueForNewInstance];
+        if (fcm_loadedInstance(self, newKeyValue)) continue; // already used by a loaded or unsaved instance
+        if (checkDatabase && [self instanceFromDatabaseWithPrimaryKey:newKeyValue]) continue; // already exists in database
+        return newKeyValue;
+    }
+}
+
++ (NSNumber *)nextSequentialPrimaryKeyValue
+{
+    if (((FCModelFieldInfo *) g_fieldInfo[self][g_primaryKeyFieldName[self]]).type != FCModelFieldTypeInteger) {
+        [[NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"FCModelPrimaryKeyGenerationSequential requires an integer primary key for %@", NSStringFromClass(self)] userInfo:nil] raise];
+    }
+
+    __block NSNumber *key = nil;
+    fcm_onInstancesQueue(^{
+        NSNumber *lastKey = g_lastSequentialPrimaryKeys[(id) self];
+        if (lastKey) g_lastSequentialPrimaryKeys[(id) self] = key = @(lastKey.longLongValue + 1);
+    });
+    if (key) return key;
+
+    // First use since opening (or since a collision): continue from the table's largest key
+    NSNumber *maxKey = [self firstValueFromQuery:@"SELECT MAX($PK) FROM $T"];
+    fcm_onInstancesQueue(^{
+        if (! g_lastSequentialPrimaryKeys) g_lastSequentialPrimaryKeys = [NSMutableDictionary dictionary];
+        int64_t lastKey = MAX([g_lastSequentialPrimaryKeys[(id) self] longLongValue], [maxKey isKindOfClass:NSNumber.class] ? maxKey.longLongValue : 0);
+        g_lastSequentialPrimaryKeys[(id) self] = key = @(lastKey + 1);
+    });
+    return key;
+}
+
+// Something else inserted past the allocator, so continue from the table's largest key as db sees it: the insert's own
+//  transaction may hold rows that readers can't see yet
++ (void)reseedSequentialPrimaryKeysInDatabase:(FMDatabase *)db
+{
+    FMResultSet *s = [db executeQuery:[self expandQuery:@"SELECT MAX($PK) FROM $T"]];
+    id maxKey = [s next] ? [s objectForColumnIndex:0] : nil;
+    [s close];
+    fcm_onInstancesQueue(^{
+        if (! g_lastSequentialPrimaryKeys) g_lastSequentialPrimaryKeys = [NSMutableDictionary dictionary];
+        int64_t lastKey = MAX([g_lastSequentialPrimaryKeys[(id) self] longLongValue], [maxKey isKindOfClass:NSNumber.class] ? [maxKey longLongValue] : 0);
+        g_lastSequentialPrimaryKeys[(id) self] = @(lastKey);
+    });
+}
+
+// A generated primary key collided with an existing row at insert time in db: replace it, keeping the instance registered
+- (void)replaceGeneratedPrimaryKeyInDatabase:(FMDatabase *)db
+{
+    Class class = self.class;
+    if (class.primaryKeyGeneration == FCModelPrimaryKeyGenerationSequential) [class reseedSequentialPrimaryKeysInDatabase:db];
+    
+    id oldKeyValue = self.primaryKey;
+    BOOL registered = (fcm_loadedInstance(class, oldKeyValue) == self);
+    [self setValue:[class generatedPrimaryKeyValueCheckingDatabase:NO] forKey:g_primaryKeyFieldName[class]];
+    if (registered) {
+        fcm_unregisterLoadedInstance(class, oldKeyValue);
+        fcm_registerLoadedInstance(class, self.primaryKey, self);
+    }
+    [FCModelNotificationCenter.defaultCenter replacePrimaryKey:oldKeyValue withPrimaryKey:self.primaryKey forClass:class];
+}
+
 - (instancetype)init
 {
     self = [self initWithFieldValues:@{} existsInDatabaseAlready:NO];
-    fcm_onMainQueue(^{
-        if (! g_instances) g_instances = [NSMutableDictionary dictionary];
-        NSMapTable *classCache = g_instances[self.class];
-        if (! classCache) classCache = g_instances[(id) self.class] = [NSMapTable strongToWeakObjectsMapTable];
-        [classCache setObject:self forKey:self.primaryKey];
-    });
+    fcm_registerLoadedInstance(self.class, self.primaryKey, self);
     return self;
 }
 
@@ -677,17 +1726,9 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
                     _inDatabaseStatus = FCModelInDatabaseStatusNotYetInserted;
                 
                     // No supplied value to primary key for a new record. Generate a unique key value.
-                    BOOL conflict = NO;
-                    int attempts = 0;
-                    do {
-                        attempts++;
-                        NSAssert1(attempts < 100, @"FCModel subclass %@ is not returning usable, unique values from primaryKeyValueForNewInstance", NSStringFromClass(self.class));
-                        
-                        id newKeyValue = [self.class primaryKeyValueForNewInstance];
-                        if ([self.class instanceFromDatabaseWithPrimaryKey:newKeyValue]) continue; // already exists in database
-                        [self setValue:newKeyValue forKey:key];
-                        conflict = NO;
-                    } while (conflict);
+                    BOOL checkDatabase = (self.class.primaryKeyGeneration == FCModelPrimaryKeyGenerationCheckDatabase);
+                    [self setValue:[self.class generatedPrimaryKeyValueCheckingDatabase:checkDatabase] forKey:key];
+                    _primaryKeyIsGenerated = ! checkDatabase;
                     
                 } else if (info.defaultValue) {
                     [self setValue:(info.defaultValue == NSNull.null ? nil : info.defaultValue) forKey:key];
@@ -695,61 +1736,267 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
             }
         }];
 
-        self._rowValuesInDatabase = _inDatabaseStatus == FCModelInDatabaseStatusRowExists ? fieldValues : nil;
-        [self didInit];
-    }
-    return self;
+        [self resetDatabaseValuesWithRow:(_inDatabaseStatus == FCModelInDatabaseStatusRowExists ? fieldValues : nil)];
+        [self didInit];
+    }
+    return self;
+}
+
+- (instancetype)initWithCurrentRowOfHydrator:(FCModelRowHydrator *)hydrator
+{
+    // Subclasses that override initWithFieldValues:existsInDatabaseAlready: still get it called for each row they load
+    if ([g_fieldValuesInitClasses containsObject:self.class]) return [self initWithFieldValues:hydrator.fieldValues existsInDatabaseAlready:YES];
+
+    if ( (self = [super init]) ) {
+        _inDatabaseStatus = FCModelInDatabaseStatusRowExists;
+        FCModelRowSnapshot *snapshot = [hydrator hydrateInstance:self];
+        [self clearDirtyFields];
+        _rowSnapshot = snapshot;
+        [self didInit];
+    }
+    return self;
+}
+
+- (void)observableObjectPropertiesWillChange
+{
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wundeclared-selector"
+    void (^willChange)(void) = ^{
+        if ([self respondsToSelector:@selector(__observableObjectPropertiesWillChange)]) {
+            [self performSelector:@selector(__observableObjectPropertiesWillChange)];
+        }
+    };
+#pragma clang diagnostic pop
+
+    if (g_database.usesPrivateQueue && ! NSThread.isMainThread) dispatch_async(dispatch_get_main_queue(), willChange);
+    else fcm_onMainQueue(willChange);
+}
+
+- (void)revertUnsavedChanges
+{
+    if (_inDatabaseStatus != FCModelInDatabaseStatusRowExists) return;
+    [self.unsavedChanges enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, id obj, BOOL *stop) {
+        [self revertUnsavedChangeToFieldName:fieldName];
+    }];
+    [self clearDirtyFields];
+}
+
+- (void)revertUnsavedChangeToFieldName:(NSString *)fieldName
+{
+    [self setValue:[self databaseValueForFieldName:fieldName] forKey:fieldName];
+}
+
+- (BOOL)hasUnsavedChanges { return _inDatabaseStatus == FCModelInDatabaseStatusNotYetInserted || self.unsavedChanges.count; }
+
+- (NSDictionary *)unsavedChanges
+{
+    NSMutableDictionary *changes = [NSMutableDictionary dictionary];
+    
+    void (^compareField)(NSString *fieldName) = ^(NSString *fieldName) {
+        id oldValue = [self databaseValueForFieldName:fieldName];
+        id newValue = [self valueForKey:fieldName];
+        if ((oldValue || newValue) && (! oldValue || (oldValue && ! newValue) || (oldValue && newValue && ! [newValue isEqual:oldValue]))) {
+            changes[fieldName] = newValue ?: NSNull.null;
+        }
+    };
+
+    // With setter tracking, only fields whose setters have been called since the last load or save can differ
+    if (g_trackedFieldNames[self.class] && _inDatabaseStatus == FCModelInDatabaseStatusRowExists) {
+        for (NSString *fieldName in _databaseValuesOfSetFields) compareField(fieldName);
+    } else {
+        NSString *pkName = g_primaryKeyFieldName[self.class];
+        [g_fieldInfo[self.class] enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, FCModelFieldInfo *info, BOOL *stop) {
+            if (! [fieldName isEqualToString:pkName]) compareField(fieldName);
+        }];
+    }
+
+    return [changes copy];
+}
+
+- (NSArray *)changedFieldNames { return self.unsavedChanges.allKeys; }
+
+#pragma mark - Change tracking
+
++ (BOOL)tracksChangesWithSetters { return NO; }
+
+// Called by tracking setters before the new value is set. The first time a field is set after a load or save, its
+//  current (database) value is kept so it can be compared, reverted, or sent in FCModelOldFieldValuesKey.
+- (void)markFieldDirtyAtIndex:(NSUInteger)index fieldName:(NSString *)fieldName forTrackedClass:(Class)trackedClass
+{
+    // An inherited or super-called setter from another model class's table has no bit position here
+    BOOL hasBit = (self.class == trackedClass);
+    if (hasBit) {
+        if (! _dirtyFieldBits) {
+            _dirtyFieldWordCount = MAX(1, (((NSArray *) g_trackedFieldNames[trackedClass]).count + 63) / 64);
+            _dirtyFieldBits = calloc(_dirtyFieldWordCount, sizeof(uint64_t));
+        }
+        
+        uint64_t bit = (1ULL << (index % 64));
+        if (index / 64 >= _dirtyFieldWordCount) hasBit = NO;
+        else if (_dirtyFieldBits[index / 64] & bit) return;
+        else _dirtyFieldBits[index / 64] |= bit;
+    }
+    
+    if (_inDatabaseStatus != FCModelInDatabaseStatusRowExists) return;
+    if (! _databaseValuesOfSetFields) _databaseValuesOfSetFields = [NSMutableDictionary dictionary];
+    if (! hasBit && _databaseValuesOfSetFields[fieldName]) return;
+    _databaseValuesOfSetFields[fieldName] = [self valueForKey:fieldName] ?: NSNull.null;
+}
+
+- (void)clearDirtyFields
+{
+    if (_dirtyFieldBits) memset(_dirtyFieldBits, 0, _dirtyFieldWordCount * sizeof(uint64_t));
+    _databaseValuesOfSetFields = nil;
+}
+
+// After loading or reloading: rowValues are the database values (NSNull for NULL), or nil if not in the database
+- (void)resetDatabaseValuesWithRow:(NSDictionary *)rowValues
+{
+    [self clearDirtyFields];
+    
+    fcm_rowSnapshotFree(_rowSnapshot);
+    _rowSnapshot = NULL;
+    if (! rowValues || g_trackedFieldNames[self.class]) return;
+    
+    FCModelRowSnapshot *snapshot = _rowSnapshot = fcm_rowSnapshotCreate(g_rowSnapshotKinds[self.class]);
+    [g_orderedFieldNames[self.class] enumerateObjectsUsingBlock:^(NSString *fieldName, NSUInteger idx, BOOL *stop) {
+        fcm_rowSnapshotSetValue(snapshot, idx, rowValues[fieldName]);
+    }];
+}
+
+// After saving: the database now matches the current values of the saved fields
+- (void)resetDatabaseValuesWithSavedChanges:(NSDictionary *)changes
+{
+    [self clearDirtyFields];
+    if (! g_trackedFieldNames[self.class]) [self resetDatabaseValuesForWrittenFields:changes];
 }
 
-- (void)observableObjectPropertiesWillChange
+// After writing only some fields (e.g. an upsert): those now match the database, and unsaved changes to others are kept
+- (void)resetDatabaseValuesForWrittenFields:(NSDictionary *)changes
 {
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wundeclared-selector"
-    fcm_onMainQueue(^{
-        if ([self respondsToSelector:@selector(__observableObjectPropertiesWillChange)]) {
-            [self performSelector:@selector(__observableObjectPropertiesWillChange)];
+    NSArray *trackedFieldNames = g_trackedFieldNames[self.class];
+    if (trackedFieldNames) {
+        for (NSString *fieldName in changes) {
+            [_databaseValuesOfSetFields removeObjectForKey:fieldName];
+            NSUInteger index = [trackedFieldNames indexOfObject:fieldName];
+            if (_dirtyFieldBits && index != NSNotFound && index / 64 < _dirtyFieldWordCount) _dirtyFieldBits[index / 64] &= ~(1ULL << (index % 64));
         }
-    });
-#pragma clang diagnostic pop
+        return;
+    }
+
+    NSDictionary *fieldOrdinals = g_fieldOrdinals[self.class];
+    if (! _rowSnapshot) _rowSnapshot = fcm_rowSnapshotCreate(g_rowSnapshotKinds[self.class]);
+    FCModelRowSnapshot *snapshot = _rowSnapshot;
+    [changes enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, id value, BOOL *stop) {
+        NSNumber *ordinal = fieldOrdinals[fieldName];
+        if (ordinal) fcm_rowSnapshotSetValue(snapshot, ordinal.unsignedIntegerValue, value);
+    }];
 }
 
-- (void)revertUnsavedChanges
+// nil for NULL or if not in the database
+- (id)databaseValueForFieldName:(NSString *)fieldName
 {
-    if (! self._rowValuesInDatabase) return;
-    [self.unsavedChanges enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, id obj, BOOL *stop) {
-        [self revertUnsavedChangeToFieldName:fieldName];
-    }];
+    id value;
+    if (_inDatabaseStatus != FCModelInDatabaseStatusRowExists) {
+        value = nil;
+    } else if (g_trackedFieldNames[self.class]) {
+        value = _databaseValuesOfSetFields[fieldName] ?: [self valueForKey:fieldName];
+    } else {
+        NSNumber *ordinal = g_fieldOrdinals[self.class][fieldName];
+        value = (ordinal && _rowSnapshot) ? fcm_rowSnapshotValue(_rowSnapshot, ordinal.unsignedIntegerValue) : nil;
+    }
+    return value == NSNull.null ? nil : value;
 }
 
-- (void)revertUnsavedChangeToFieldName:(NSString *)fieldName
+// Every field's database value, NSNull for NULL, or nil if not in the database
+- (NSDictionary *)databaseValues
 {
-    id oldValue = self._rowValuesInDatabase ? self._rowValuesInDatabase[fieldName] : nil;
-    [self setValue:(oldValue == NSNull.null ? nil : oldValue) forKey:fieldName];
+    if (_inDatabaseStatus != FCModelInDatabaseStatusRowExists) return nil;
+    NSArray *fieldNames = g_orderedFieldNames[self.class];
+    NSMutableDictionary *values = [NSMutableDictionary dictionaryWithCapacity:fieldNames.count];
+    for (NSString *fieldName in fieldNames) values[fieldName] = [self databaseValueForFieldName:fieldName] ?: NSNull.null;
+    return [values copy];
 }
 
-- (BOOL)hasUnsavedChanges { return _inDatabaseStatus == FCModelInDatabaseStatusNotYetInserted || self.unsavedChanges.count; }
+- (void)dealloc
+{
+    free(_dirtyFieldBits);
+    fcm_rowSnapshotFree(_rowSnapshot);
+}
 
-- (NSDictionary *)unsavedChanges
+// Replaces the setters of a class's non-PK fields with wrappers that set the field's dirty bit, then call the original.
+//  Returns the tracked field names in bit order, or nil if this class can't be tracked and must diff every field.
++ (NSArray *)installChangeTrackingSettersWithFieldInfo:(NSDictionary *)fieldInfo primaryKeyName:(NSString *)pkName
 {
-    NSMutableDictionary *changes = [NSMutableDictionary dictionary];
+    // Swift code can set non-dynamic properties without calling their Objective-C setters
+    if (! [self tracksChangesWithSetters] || [NSStringFromClass(self) containsString:@"."]) return nil;
     
-    [g_fieldInfo[self.class] enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, FCModelFieldInfo *info, BOOL *stop) {
-        if ([fieldName isEqualToString:g_primaryKeyFieldName[self.class]]) return;
-
-        NSDictionary *rowValuesInDatabase = self._rowValuesInDatabase;
-        id oldValue = rowValuesInDatabase && [rowValuesInDatabase isKindOfClass:NSDictionary.class] ? rowValuesInDatabase[fieldName] : nil;
-        oldValue = (oldValue == NSNull.null ? nil : oldValue);
+    NSMutableArray *fieldNames = [[fieldInfo.allKeys sortedArrayUsingSelector:@selector(compare:)] mutableCopy];
+    [fieldNames removeObject:pkName];
+    for (NSString *fieldName in fieldNames) {
+        FCModelFieldInfo *info = fieldInfo[fieldName];
+        if (! info.setterIMP || ! strchr("@cCBsSiIlLqQfd", info.valueType) || ! info.valueType) return nil;
+    }
+    
+    if (! g_changeTrackingSetters) g_changeTrackingSetters = [NSMutableArray array];
+    if (! g_originalIMPsByTrackingIMP) g_originalIMPsByTrackingIMP = [NSMutableDictionary dictionary];
+    
+    Class trackedClass = self;
+    [fieldNames enumerateObjectsUsingBlock:^(NSString *fieldName, NSUInteger index, BOOL *stop) {
+        FCModelFieldInfo *info = fieldInfo[fieldName];
+        SEL setter = info.setter;
+        Method method = class_getInstanceMethod(trackedClass, setter);
+        IMP originalIMP = method_getImplementation(method);
         
-        id newValue = [self valueForKey:fieldName];
-        if ((oldValue || newValue) && (! oldValue || (oldValue && ! newValue) || (oldValue && newValue && ! [newValue isEqual:oldValue]))) {
-            changes[fieldName] = newValue ?: NSNull.null;
+        // If this setter is inherited from another tracked model class, wrap its original instead of its wrapper
+        NSValue *inheritedOriginal = g_originalIMPsByTrackingIMP[[NSValue valueWithPointer:(const void *) originalIMP]];
+        if (inheritedOriginal) originalIMP = (IMP) inheritedOriginal.pointerValue;
+        info.setterIMP = originalIMP; // row hydration sets fields without marking them
+
+#define FCMTrackingSetter(type) imp_implementationWithBlock(^(FCModel *instance, type value) { \
+            [instance markFieldDirtyAtIndex:index fieldName:fieldName forTrackedClass:trackedClass]; \
+            ((void (*)(id, SEL, type)) originalIMP)(instance, setter, value); \
+        })
+        IMP trackingIMP;
+        switch (info.valueType) {
+            case 'c': trackingIMP = FCMTrackingSetter(char); break;
+            case 'C': trackingIMP = FCMTrackingSetter(unsigned char); break;
+            case 'B': trackingIMP = FCMTrackingSetter(bool); break;
+            case 's': trackingIMP = FCMTrackingSetter(short); break;
+            case 'S': trackingIMP = FCMTrackingSetter(unsigned short); break;
+            case 'i': trackingIMP = FCMTrackingSetter(int); break;
+            case 'I': trackingIMP = FCMTrackingSetter(unsigned int); break;
+            case 'l': trackingIMP = FCMTrackingSetter(long); break;
+            case 'L': trackingIMP = FCMTrackingSetter(unsigned long); break;
+            case 'q': trackingIMP = FCMTrackingSetter(long long); break;
+            case 'Q': trackingIMP = FCMTrackingSetter(unsigned long long); break;
+            case 'f': trackingIMP = FCMTrackingSetter(float); break;
+            case 'd': trackingIMP = FCMTrackingSetter(double); break;
+            default:  trackingIMP = FCMTrackingSetter(id); break;
         }
-    }];
+#undef FCMTrackingSetter
 
-    return [changes copy];
+        class_replaceMethod(trackedClass, setter, trackingIMP, method_getTypeEncoding(method));
+        g_originalIMPsByTrackingIMP[[NSValue valueWithPointer:(const void *) trackingIMP]] = [NSValue valueWithPointer:(const void *) originalIMP];
+        [g_changeTrackingSetters addObject:@[ trackedClass, NSStringFromSelector(setter), [NSValue valueWithPointer:(const void *) originalIMP] ]];
+    }];
+    
+    return [fieldNames copy];
 }
 
-- (NSArray *)changedFieldNames { return self.unsavedChanges.allKeys; }
+// Restores the original setters when the database closes, since the next one may map different fields
++ (void)removeChangeTrackingSetters
+{
+    for (NSArray *entry in g_changeTrackingSetters) {
+        Class class = entry[0];
+        SEL setter = NSSelectorFromString(entry[1]);
+        Method method = class_getInstanceMethod(class, setter);
+        if (method) method_setImplementation(method, (IMP) ((NSValue *) entry[2]).pointerValue);
+    }
+    [g_changeTrackingSetters removeAllObjects];
+    [g_originalIMPsByTrackingIMP removeAllObjects];
+    g_trackedFieldNames = nil;
+}
 
 - (BOOL)_save
 {
@@ -760,31 +2007,30 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     __block NSSet *changedFields;
     __block FCModelChangeType changeType = FCModelChangeTypeUnspecified;
     __block NSDictionary *previousRowValuesInDatabase = nil;
-    fcm_onMainQueue(^{
+    fcm_onDatabaseQueue(^{
         [g_database inDatabase:^(FMDatabase *db) {
         
             NSDictionary *changes = self.unsavedChanges;
             BOOL dirty = changes.count;
             if (! dirty && _inDatabaseStatus == FCModelInDatabaseStatusRowExists) { hadChanges = NO; return; }
-            
+
             BOOL update = (_inDatabaseStatus == FCModelInDatabaseStatusRowExists);
             NSArray *columnNames;
             NSMutableArray *values;
             
-            NSString *tableName = [self.class tableName];
-            NSString *pkName = g_primaryKeyFieldName[self.class];
+            FCModelClassSQL *classSQL = g_classSQL[self.class];
+            NSString *tableName = classSQL.tableName;
             id primaryKey = self.primaryKey;
             NSAssert1(primaryKey && (primaryKey != NSNull.null), @"Cannot update %@ without primary key value", NSStringFromClass(self.class));
            
             if (update) {
-                columnNames = [changes allKeys];
+                // Sorted so that each distinct set of changed columns maps to one cached UPDATE statement
+                columnNames = [[changes allKeys] sortedArrayUsingSelector:@selector(compare:)];
                 changedFields = [NSSet setWithArray:columnNames];
                 changeType = FCModelChangeTypeUpdate;
             } else {
                 changedFields = [NSSet setWithArray:self.class.databaseFieldNames];
-                NSMutableSet *columnNamesMinusPK = [[NSSet setWithArray:[g_fieldInfo[self.class] allKeys]] mutableCopy];
-                [columnNamesMinusPK removeObject:pkName];
-                columnNames = [columnNamesMinusPK allObjects];
+                columnNames = classSQL.insertColumnNames;
                 changeType = FCModelChangeTypeInsert;
             }
 
@@ -806,53 +2052,42 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 
             NSString *query;
             if (update) {
-                query = [NSString stringWithFormat:
-                    @"UPDATE \"%@\" SET \"%@\"=? WHERE \"%@\"=?",
-                    tableName,
-                    [columnNames componentsJoinedByString:@"\"=?,\""],
-                    pkName
-                ];
-                
+                query = [classSQL updateForColumnNames:columnNames];
                 queryProfileStart( ([NSString stringWithFormat:@"%@::save -- update", tableName]) );
             } else {
-                if (columnNames.count > 0) {
-                    query = [NSString stringWithFormat:
-                        @"INSERT INTO \"%@\" (\"%@\",\"%@\") VALUES (%@?)",
-                        tableName,
-                        [columnNames componentsJoinedByString:@"\",\""],
-                        pkName,
-                        [@"" stringByPaddingToLength:(columnNames.count * 2) withString:@"?," startingAtIndex:0]
-                    ];
-                } else {
-                    query = [NSString stringWithFormat:
-                        @"INSERT INTO \"%@\" (\"%@\") VALUES (?)",
-                        tableName,
-                        pkName
-                    ];
-                }
-
+                query = classSQL.insert;
                 queryProfileStart( ([NSString stringWithFormat:@"%@::save -- insert", tableName]) );
             }
 
+            // Only once nothing above can raise, so a failed save never leaves a group's transaction open
+            [self.class beginGroupCommitIfPossibleInDatabase:db];
             g_database.isInInternalWrite = YES;
             BOOL success = NO;
             success = [db executeUpdate:query withArgumentsInArray:values];
+            
+            // A generated key that wasn't checked against the database may already exist: replace it and retry
+            for (int attempts = 0; ! success && ! update && _primaryKeyIsGenerated && attempts < 100 && sqlite3_extended_errcode(db.sqliteHandle) == SQLITE_CONSTRAINT_PRIMARYKEY; attempts++) {
+                [self replaceGeneratedPrimaryKeyInDatabase:db];
+                values[values.count - 1] = self.primaryKey;
+                changes = self.unsavedChanges;
+                success = [db executeUpdate:query withArgumentsInArray:values];
+            }
             queryProfileEnd();
             g_database.isInInternalWrite = NO;
             if (! success || db.lastErrorCode) [self.class queryFailedInDatabase:db];
             
-            previousRowValuesInDatabase = self._rowValuesInDatabase;
-            NSMutableDictionary *newRowValues = previousRowValuesInDatabase ? [previousRowValuesInDatabase mutableCopy] : [NSMutableDictionary dictionary];
-            [changes enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, id obj, BOOL *stop) {
-                newRowValues[fieldName] = obj ?: NSNull.null;
-            }];
-            self._rowValuesInDatabase = newRowValues;
+            // Old values are only sent in immediate (not queued) update notifications
+            if (update && ! g_database.isQueuingNotifications) previousRowValuesInDatabase = [self databaseValues];
             _inDatabaseStatus = FCModelInDatabaseStatusRowExists;
+            [self resetDatabaseValuesWithSavedChanges:changes];
 
             hadChanges = YES;
         }];
         
-        if (hadChanges) [self.class postChangeNotificationWithChangedFields:changedFields changedObject:self changeType:changeType priorFieldValues:previousRowValuesInDatabase];
+        if (hadChanges) {
+            [self.class postChangeNotificationWithChangedFields:changedFields changedObject:self changeType:changeType priorFieldValues:previousRowValuesInDatabase];
+            [self.class groupCommitDidSave];
+        }
     });
     return hadChanges;
 }
@@ -862,13 +2097,15 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     checkForOpenDatabaseFatal(YES);
     __block id pkValue = nil;
 
-    fcm_onMainQueue(^{
+    fcm_onDatabaseQueue(^{
+        // Not part of a group commit, so its notification isn't held until the group commits
+        [self.class flushGroupCommit];
         [g_database inDatabase:^(FMDatabase *db) {
             if (_inDatabaseStatus == FCModelInDatabaseStatusDeleted) return;
             pkValue = self.primaryKey;
             
             __block BOOL success = NO;
-            NSString *query = [self.class expandQuery:@"DELETE FROM \"$T\" WHERE \"$PK\" = ?"];
+            NSString *query = ((FCModelClassSQL *) g_classSQL[self.class]).deleteByPrimaryKey;
             g_database.isInInternalWrite = YES;
             queryProfileStart(query);
             success = [db executeUpdate:query, [self primaryKey]];
@@ -879,12 +2116,355 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
             _inDatabaseStatus = FCModelInDatabaseStatusDeleted;
         }];
     
-        [g_instances[self.class] removeObjectForKey:pkValue];
+        fcm_unregisterLoadedInstance(self.class, pkValue);
 
         [self.class postChangeNotificationWithChangedFields:nil changedObject:self changeType:FCModelChangeTypeDelete priorFieldValues:nil];
     });
 }
 
+#pragma mark - Bulk insert
+
++ (BOOL)insertInstances:(NSArray *)instances { return [self _insertInstances:instances generatedPrimaryKeys:nil]; }
+
++ (NSArray *)insertInstancesWithFieldValues:(NSArray *)fieldValueDictionaries
+{
+    checkForOpenDatabaseFatal(YES);
+    NSString *pkName = g_primaryKeyFieldName[self];
+    NSMutableArray *instances = [NSMutableArray arrayWithCapacity:fieldValueDictionaries.count];
+    NSMutableIndexSet *generatedKeyIndexes = [NSMutableIndexSet indexSet];
+    
+    [fieldValueDictionaries enumerateObjectsUsingBlock:^(NSDictionary *fieldValues, NSUInteger idx, BOOL *stop) {
+        if (! fieldValues[pkName] || fieldValues[pkName] == NSNull.null) {
+            // Only checked against loaded instances here, not the database: a collision fails the INSERT, which is retried
+            id newKeyValue = [self generatedPrimaryKeyValueCheckingDatabase:NO];
+            NSMutableDictionary *valuesWithKey = [fieldValues mutableCopy];
+            valuesWithKey[pkName] = newKeyValue;
+            fieldValues = valuesWithKey;
+            [generatedKeyIndexes addIndex:idx];
+        }
+        [instances addObject:[[self alloc] initWithFieldValues:fieldValues existsInDatabaseAlready:NO]];
+    }];
+
+    return [self _insertInstances:instances generatedPrimaryKeys:generatedKeyIndexes] ? instances : nil;
+}
+
+// generatedKeyIndexes: indexes of instances whose primary keys may be replaced if they collide with existing rows
++ (BOOL)_insertInstances:(NSArray *)instances generatedPrimaryKeys:(NSIndexSet *)generatedKeyIndexes
+{
+    checkForOpenDatabaseFatal(YES);
+    if (instances.count == 0) return YES;
+    
+    FCModelClassSQL *classSQL = g_classSQL[self];
+    NSString *pkName = g_primaryKeyFieldName[self];
+    NSArray *columnNames = classSQL.insertColumnNames;
+    
+    // Validate everything before writing anything, with the NOT NULL field list built once for the class
+    NSMutableArray *notNullFieldNames = [NSMutableArray array];
+    [g_fieldInfo[self] enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, FCModelFieldInfo *info, BOOL *stop) {
+        if (! info.nullAllowed) [notNullFieldNames addObject:fieldName];
+    }];
+    NSUInteger validatedIndex = 0;
+    for (FCModel *instance in instances) {
+        if (instance.class != self || instance->_inDatabaseStatus != FCModelInDatabaseStatusNotYetInserted) {
+            [[NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"insertInstances: requires new, unsaved instances of %@", NSStringFromClass(self)] userInfo:nil] raise];
+        }
+
+        // A supplied key that another loaded instance already has would leave two instances for one row. Generated keys
+        //  were chosen to avoid loaded instances' keys, and are replaced if they collide at insert time.
+        if (! ([generatedKeyIndexes containsIndex:validatedIndex++] || instance->_primaryKeyIsGenerated)) {
+            FCModel *loadedInstance = fcm_loadedInstance(self, instance.primaryKey);
+            if (loadedInstance && loadedInstance != instance) {
+                [[NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"insertInstances: an instance of %@ with primary key %@ is already loaded", NSStringFromClass(self), instance.primaryKey] userInfo:nil] raise];
+            }
+        }
+        for (NSString *fieldName in notNullFieldNames) {
+            id value = [instance valueForKey:fieldName];
+            if (! value || value == NSNull.null) {
+                [[NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"Cannot save NULL to NOT NULL property %@.%@", classSQL.tableName, fieldName] userInfo:nil] raise];
+            }
+        }
+    }
+
+    __block BOOL success = YES;
+    NSMutableArray *insertedValues = [NSMutableArray arrayWithCapacity:instances.count];
+    [self inDatabaseSync:^(FMDatabase *db) {
+        // Inside an existing transaction, a savepoint lets a failed batch be undone without rolling back the rest of it
+        BOOL ownTransaction = ! db.inTransaction;
+        if (ownTransaction) [db beginTransaction];
+        else [db executeUpdate:@"SAVEPOINT FCModelInsertInstances"];
+        
+        int errorCode = SQLITE_OK;
+        NSString *errorMessage = nil;
+        BOOL constraintFailed = NO;
+        g_database.isInInternalWrite = YES;
+        queryProfileStart( ([NSString stringWithFormat:@"%@::insertInstances", classSQL.tableName]) );
+        NSUInteger idx = 0;
+        for (FCModel *instance in instances) {
+            @autoreleasepool {
+                NSMutableDictionary *rowValues = [NSMutableDictionary dictionaryWithCapacity:columnNames.count + 1];
+                NSMutableArray *values = [NSMutableArray arrayWithCapacity:columnNames.count + 1];
+                for (NSString *columnName in columnNames) {
+                    id value = [instance valueForKey:columnName] ?: NSNull.null;
+                    rowValues[columnName] = value;
+                    [values addObject:value];
+                }
+                
+                int attempts = 0;
+                BOOL inserted = NO;
+                do {
+                    id primaryKey = instance.primaryKey;
+                    NSAssert1(primaryKey && (primaryKey != NSNull.null), @"Cannot insert %@ without primary key value", NSStringFromClass(self));
+                    inserted = [db executeUpdate:classSQL.insert withArgumentsInArray:[values arrayByAddingObject:primaryKey]];
+                    if (inserted || ! ([generatedKeyIndexes containsIndex:idx] || instance->_primaryKeyIsGenerated) || sqlite3_extended_errcode(db.sqliteHandle) != SQLITE_CONSTRAINT_PRIMARYKEY) break;
+                    [instance replaceGeneratedPrimaryKeyInDatabase:db];
+                } while (++attempts < 100);
+                
+                if (! inserted) {
+                    errorCode = db.lastErrorCode;
+                    errorMessage = db.lastErrorMessage;
+                    constraintFailed = ((sqlite3_extended_errcode(db.sqliteHandle) & 0xFF) == SQLITE_CONSTRAINT);
+                    if (constraintFailed) NSLog(@"[FCModel] insertInstances: %@ with primary key %@ failed: %@", NSStringFromClass(self), instance.primaryKey, errorMessage);
+                    success = NO;
+                    break;
+                }
+                rowValues[pkName] = instance.primaryKey;
+                [insertedValues addObject:rowValues];
+            }
+            idx++;
+        }
+        queryProfileEnd();
+        g_database.isInInternalWrite = NO;
+        
+        if (! success) {
+            if (ownTransaction) [db rollback];
+            else {
+                [db executeUpdate:@"ROLLBACK TO FCModelInsertInstances"];
+                [db executeUpdate:@"RELEASE FCModelInsertInstances"];
+            }
+            
+            // A row that can't be inserted (e.g. a supplied key that already exists) fails the batch, not the database
+            if (! constraintFailed) [self queryFailedWithErrorCode:errorCode message:errorMessage];
+            return;
+        }
+        if (ownTransaction) [db commit];
+        else [db executeUpdate:@"RELEASE FCModelInsertInstances"];
+        
+        FCModelKeyChanges *keyChanges = [FCModelKeyChanges new];
+        [instances enumerateObjectsUsingBlock:^(FCModel *instance, NSUInteger idx, BOOL *stop) {
+            instance->_inDatabaseStatus = FCModelInDatabaseStatusRowExists;
+            [instance resetDatabaseValuesWithSavedChanges:insertedValues[idx]];
+            fcm_registerLoadedInstance(self, instance.primaryKey, instance);
+            [keyChanges recordChangeType:FCModelChangeTypeInsert primaryKeyValue:instance.primaryKey];
+        }];
+
+        [self postChangeNotificationWithChangedFields:[NSSet setWithArray:self.databaseFieldNames] changedObject:nil changeType:FCModelChangeTypeInsert priorFieldValues:nil keyChanges:keyChanges additionalUserInfo:nil];
+    }];
+    
+    return success;
+}
+
+#pragma mark - Upsert
+
++ (BOOL)upsertWithFieldValues:(NSDictionary *)fieldValues { return [self upsertWithFieldValueDictionaries:@[ fieldValues ]]; }
+
++ (BOOL)upsertWithFieldValueDictionaries:(NSArray *)fieldValueDictionaries
+{
+    checkForOpenDatabaseFatal(YES);
+    if (fieldValueDictionaries.count == 0) return YES;
+    
+    FCModelClassSQL *classSQL = g_classSQL[self];
+    NSString *pkName = classSQL.primaryKeyName;
+    NSDictionary *fieldInfo = g_fieldInfo[self];
+    
+    // Validate everything before writing anything
+    for (NSDictionary *fieldValues in fieldValueDictionaries) {
+        id primaryKey = fieldValues[pkName];
+        if (! primaryKey || primaryKey == NSNull.null) {
+            [[NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"Cannot upsert %@ without primary key value", NSStringFromClass(self)] userInfo:nil] raise];
+        }
+        [fieldValues enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, id value, BOOL *stop) {
+            FCModelFieldInfo *info = fieldInfo[fieldName];
+            if (! info) {
+                [[NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"Cannot upsert unknown property %@.%@", classSQL.tableName, fieldName] userInfo:nil] raise];
+            }
+            if (value == NSNull.null && ! info.nullAllowed) {
+                [[NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"Cannot save NULL to NOT NULL property %@.%@", classSQL.tableName, fieldName] userInfo:nil] raise];
+            }
+        }];
+    }
+    
+    __block BOOL success = YES;
+    [self inDatabaseSync:^(FMDatabase *db) {
+        BOOL ownTransaction = fieldValueDictionaries.count > 1 && ! db.inTransaction;
+        if (ownTransaction) [db beginTransaction];
+        
+        // The update hook reports whether each row took the INSERT or the DO UPDATE path
+        int errorCode = SQLITE_OK;
+        NSString *errorMessage = nil;
+        NSMutableArray *operations = [NSMutableArray arrayWithCapacity:fieldValueDictionaries.count];
+        g_database.isInInternalWrite = YES;
+        g_database.internalWriteClass = self;
+        queryProfileStart( ([NSString stringWithFormat:@"%@::upsert", classSQL.tableName]) );
+        for (NSDictionary *fieldValues in fieldValueDictionaries) {
+            @autoreleasepool {
+                NSMutableArray *columnNames = [fieldValues.allKeys mutableCopy];
+                [columnNames removeObject:pkName];
+                [columnNames sortUsingSelector:@selector(compare:)];
+                
+                NSMutableArray *values = [NSMutableArray arrayWithCapacity:columnNames.count + 1];
+                for (NSString *columnName in columnNames) [values addObject:fieldValues[columnName]];
+                [values addObject:fieldValues[pkName]];
+                
+                g_database.lastInternalWriteOperation = 0;
+                if (! [db executeUpdate:[classSQL upsertForColumnNames:columnNames] withArgumentsInArray:values]) {
+                    errorCode = db.lastErrorCode;
+                    errorMessage = db.lastErrorMessage;
+                    success = NO;
+                    break;
+                }
+                [operations addObject:@(g_database.lastInternalWriteOperation)];
+            }
+        }
+        queryProfileEnd();
+        g_database.isInInternalWrite = NO;
+        g_database.internalWriteClass = nil;
+        
+        if (! success) {
+            if (ownTransaction) [db rollback];
+            [self queryFailedWithErrorCode:errorCode message:errorMessage];
+            return;
+        }
+        if (ownTransaction) [db commit];
+        
+        // Bring any loaded instances up to date, since the rows were never read
+        NSMutableSet *changedFields = [NSMutableSet set];
+        FCModelKeyChanges *keyChanges = [FCModelKeyChanges new];
+        BOOL anyInserted = NO, anyUpdated = NO;
+        FCModel *changedObject = nil;
+        NSDictionary *priorFieldValues = nil;
+        NSUInteger idx = 0;
+        for (NSDictionary *fieldValues in fieldValueDictionaries) {
+            int operation = [operations[idx++] intValue];
+            if (operation == SQLITE_INSERT) {
+                anyInserted = YES;
+                [changedFields addObjectsFromArray:self.databaseFieldNames];
+            } else if (operation == SQLITE_UPDATE) {
+                anyUpdated = YES;
+                [changedFields addObjectsFromArray:fieldValues.allKeys];
+                [changedFields removeObject:pkName];
+            } else continue; // conflicting row with nothing to update
+            
+            id primaryKeyValue = [self normalizedPrimaryKeyValue:fieldValues[pkName]];
+            [keyChanges recordChangeType:(operation == SQLITE_INSERT ? FCModelChangeTypeInsert : FCModelChangeTypeUpdate) primaryKeyValue:primaryKeyValue];
+            FCModel *instance = fcm_loadedInstance(self, primaryKeyValue);
+            if (! instance) continue;
+            
+            if (instance->_inDatabaseStatus == FCModelInDatabaseStatusRowExists) {
+                if (fieldValueDictionaries.count == 1 && operation == SQLITE_UPDATE && ! g_database.isQueuingNotifications) priorFieldValues = [instance databaseValues];
+                [instance observableObjectPropertiesWillChange];
+                [fieldValues enumerateKeysAndObjectsUsingBlock:^(NSString *fieldName, id value, BOOL *stop) {
+                    if (! [fieldName isEqualToString:pkName]) [instance setValue:(value == NSNull.null ? nil : value) forKey:fieldName];
+                }];
+                [instance resetDatabaseValuesForWrittenFields:fieldValues];
+            } else if (instance->_inDatabaseStatus == FCModelInDatabaseStatusNotYetInserted) {
+                // Other columns may hold defaults or existing values, so read the whole row into the unsaved instance
+                instance->_inDatabaseStatus = FCModelInDatabaseStatusRowExists;
+                [instance reload];
+            }
+            changedObject = instance;
+        }
+        
+        if (! anyInserted && ! anyUpdated) return;
+        if (fieldValueDictionaries.count == 1) {
+            [self postChangeNotificationWithChangedFields:changedFields changedObject:changedObject changeType:(anyInserted ? FCModelChangeTypeInsert : FCModelChangeTypeUpdate) priorFieldValues:priorFieldValues keyChanges:keyChanges additionalUserInfo:nil];
+        } else {
+            [self postChangeNotificationWithChangedFields:changedFields changedObject:nil changeType:(anyInserted && anyUpdated ? FCModelChangeTypeUnspecified : (anyInserted ? FCModelChangeTypeInsert : FCModelChangeTypeUpdate)) priorFieldValues:nil keyChanges:keyChanges additionalUserInfo:nil];
+        }
+    }];
+    
+    return success;
+}
+
+#pragma mark - Batch delete
+
++ (void)deleteInstances:(NSArray *)instances
+{
+    NSMutableArray *primaryKeyValues = [NSMutableArray arrayWithCapacity:instances.count];
+    for (FCModel *instance in instances) {
+        if (instance.class != self) {
+            [[NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"deleteInstances: requires instances of %@", NSStringFromClass(self)] userInfo:nil] raise];
+        }
+        if (instance->_inDatabaseStatus == FCModelInDatabaseStatusRowExists) [primaryKeyValues addObject:instance.primaryKey];
+    }
+    [self deleteInstancesWithPrimaryKeyValues:primaryKeyValues];
+}
+
++ (void)deleteInstancesWithPrimaryKeyValues:(NSArray *)primaryKeyValues
+{
+    checkForOpenDatabaseFatal(YES);
+    if (primaryKeyValues.count == 0) return;
+    
+    FCModelClassSQL *classSQL = g_classSQL[self];
+    NSMutableArray *normalizedKeyValues = [NSMutableArray arrayWithCapacity:primaryKeyValues.count];
+    for (id pkValue in primaryKeyValues) {
+        id normalizedKeyValue = [self normalizedPrimaryKeyValue:pkValue];
+        if (normalizedKeyValue) [normalizedKeyValues addObject:normalizedKeyValue];
+    }
+    
+    [self inDatabaseSync:^(FMDatabase *db) {
+        BOOL ownTransaction = ! db.inTransaction;
+        if (ownTransaction) [db beginTransaction];
+        
+        // Every full chunk uses the same SQL, so they share one cached statement
+        NSUInteger chunkSize = (NSUInteger) fcm_maxQueryParameterCount();
+        NSString *fullChunkQuery = nil;
+        BOOL success = YES;
+        int deletedRowCount = 0;
+        g_database.isInInternalWrite = YES;
+        queryProfileStart( ([NSString stringWithFormat:@"%@::deleteInstances", classSQL.tableName]) );
+        for (NSUInteger offset = 0; offset < normalizedKeyValues.count; offset += chunkSize) {
+            NSArray *chunk = [normalizedKeyValues subarrayWithRange:NSMakeRange(offset, MIN(chunkSize, normalizedKeyValues.count - offset))];
+            NSString *query = (chunk.count == chunkSize ? fullChunkQuery : nil);
+            if (! query) {
+                query = [NSString stringWithFormat:
+                    @"DELETE FROM \"%@\" WHERE \"%@\" IN (%@)",
+                    classSQL.tableName,
+                    classSQL.primaryKeyName,
+                    [[@"" stringByPaddingToLength:(chunk.count * 2) withString:@"?," startingAtIndex:0] substringToIndex:(chunk.count * 2 - 1)]
+                ];
+                if (chunk.count == chunkSize) fullChunkQuery = query;
+            }
+            
+            if (! (success = [db executeUpdate:query withArgumentsInArray:chunk])) break;
+            deletedRowCount += db.changes;
+        }
+        queryProfileEnd();
+        g_database.isInInternalWrite = NO;
+        
+        if (! success) {
+            int errorCode = db.lastErrorCode;
+            NSString *errorMessage = db.lastErrorMessage;
+            if (ownTransaction) [db rollback];
+            [self queryFailedWithErrorCode:errorCode message:errorMessage];
+            return;
+        }
+        if (ownTransaction) [db commit];
+        
+        for (id pkValue in normalizedKeyValues) {
+            FCModel *instance = fcm_loadedInstance(self, pkValue);
+            if (! instance) continue;
+            instance->_inDatabaseStatus = FCModelInDatabaseStatusDeleted;
+            fcm_unregisterLoadedInstance(self, pkValue);
+        }
+        
+        if (deletedRowCount) {
+            FCModelKeyChanges *keyChanges = [FCModelKeyChanges new];
+            for (id pkValue in normalizedKeyValues) [keyChanges recordChangeType:FCModelChangeTypeDelete primaryKeyValue:pkValue];
+            [self postChangeNotificationWithChangedFields:nil changedObject:nil changeType:FCModelChangeTypeDelete priorFieldValues:nil keyChanges:keyChanges additionalUserInfo:nil];
+        }
+    }];
+}
+
 #pragma mark - Utilities
 
 - (id)primaryKey { return g_primaryKeyFieldName[self.class] ? [self valueForKey:g_primaryKeyFieldName[self.class]] : nil; }
@@ -947,6 +2527,15 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 
 + (void)removeObserverForFieldChanges:(id)target { [FCModelNotificationCenter.defaultCenter removeFieldChangeObservers:target]; }
 
+- (void)addObserver:(id)target selector:(SEL)action forChangedFields:(NSSet *)fieldNamesToWatch
+{
+    id primaryKey = self.primaryKey;
+    if (! primaryKey) [[NSException exceptionWithName:NSInvalidArgumentException reason:@"Cannot observe an instance without a primary-key value" userInfo:nil] raise];
+    [FCModelNotificationCenter.defaultCenter addObserver:target selector:action class:self.class primaryKey:primaryKey changedFields:fieldNamesToWatch];
+}
+
+- (void)removeObserverForFieldChanges:(id)target { [FCModelNotificationCenter.defaultCenter removeFieldChangeObservers:target class:self.class primaryKey:self.primaryKey]; }
+
 
 #pragma mark - Database management
 
@@ -956,15 +2545,28 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 }
 
 + (void)openDatabaseAtPath:(NSString *)path withDatabaseInitializer:(void (^)(FMDatabase *db))databaseInitializer schemaBuilder:(void (^)(FMDatabase *db, int *schemaVersion))schemaBuilder moduleName:(NSString *)moduleName
+{
+    [self openDatabaseAtPath:path withDatabaseInitializer:databaseInitializer schemaBuilder:schemaBuilder moduleName:moduleName options:FCModelDatabaseOptionsNone];
+}
+
++ (void)openDatabaseAtPath:(NSString *)path withDatabaseInitializer:(void (^)(FMDatabase *db))databaseInitializer schemaBuilder:(void (^)(FMDatabase *db, int *schemaVersion))schemaBuilder moduleName:(NSString *)moduleName options:(FCModelDatabaseOptions)options
 {
     dispatch_assert_queue(dispatch_get_main_queue());
 
-    g_database = [[FCModelDatabase alloc] initWithDatabasePath:path];
+    NSUInteger readerCount = (options & FCModelDatabaseOptionConcurrentReaders) ? MAX(2, NSProcessInfo.processInfo.activeProcessorCount) : 0;
+    g_database = [[FCModelDatabase alloc] initWithDatabasePath:path usingPrivateQueue:((options & FCModelDatabaseOptionPrivateQueue) != 0) maxConcurrentReaders:readerCount];
+    g_database.databaseInitializer = databaseInitializer;
     NSMutableDictionary *mutableFieldInfo = [NSMutableDictionary dictionary];
     NSMutableDictionary *mutableIgnoredFieldNames = [NSMutableDictionary dictionary];
     NSMutableDictionary *mutablePrimaryKeyFieldName = [NSMutableDictionary dictionary];
+    NSMutableDictionary *mutableClassSQL = [NSMutableDictionary dictionary];
+    NSMutableDictionary *mutableTrackedFieldNames = [NSMutableDictionary dictionary];
+    NSMutableDictionary *mutableClassesByTableName = [NSMutableDictionary dictionary];
+    NSMutableSet *mutableRowIDPrimaryKeyClasses = [NSMutableSet set];
+    NSMutableSet *mutableFieldValuesInitClasses = [NSMutableSet set];
+    SEL fieldValuesInit = @selector(initWithFieldValues:existsInDatabaseAlready:);
     
-    [g_database inDatabase:^(FMDatabase *db) {
+    fcm_onDatabaseQueue(^{ [g_database inDatabase:^(FMDatabase *db) {
         if (databaseInitializer) databaseInitializer(db);
 
         int startingSchemaVersion = 0;
@@ -999,6 +2601,7 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
             
             NSString *primaryKeyName = nil;
             int primaryKeyColumnCount = 0;
+            BOOL primaryKeyIsRowID = NO;
             NSMutableDictionary *fields = [NSMutableDictionary dictionary];
             NSMutableSet *ignoredFieldNames = [([tableModelClass ignoredFieldNames] ?: [NSSet set]) mutableCopy];
             
@@ -1043,12 +2646,26 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
                 if (isPK) {
                     primaryKeyColumnCount++;
                     primaryKeyName = fieldName;
+                    
+                    // Only a column declared exactly "INTEGER PRIMARY KEY" is an alias for the rowid
+                    primaryKeyIsRowID = ([[columnsRS stringForColumnIndex:2] caseInsensitiveCompare:@"INTEGER"] == NSOrderedSame);
+                }
+
+                NSString *setterName = nil;
+                for (NSString *attribute in propertyAttributes) {
+                    if ([attribute hasPrefix:@"S"]) setterName = [attribute substringFromIndex:1];
                 }
+                if (! setterName) setterName = [NSString stringWithFormat:@"set%@%@:", [fieldName substringToIndex:1].uppercaseString, [fieldName substringFromIndex:1]];
+                SEL setter = NSSelectorFromString(setterName);
+                Method setterMethod = class_getInstanceMethod(tableModelClass, setter);
 
                 NSString *fieldType = [columnsRS stringForColumnIndex:2];
                 FCModelFieldInfo *info = [FCModelFieldInfo new];
                 info.propertyClass = propertyClass;
                 info.propertyTypeEncoding = [typeString substringFromIndex:1];
+                info.valueType = typeString.length > 1 ? (char) [typeString characterAtIndex:1] : 0;
+                info.setter = setter;
+                info.setterIMP = setterMethod ? method_getImplementation(setterMethod) : NULL;
                 info.nullAllowed = ! [columnsRS boolForColumnIndex:3];
                 
                 if (! isPK && info.nullAllowed && ! propertyClass) {
@@ -1109,6 +2726,14 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
             id classKey = tableModelClass;
             [mutableFieldInfo setObject:fields forKey:classKey];
             [mutablePrimaryKeyFieldName setObject:primaryKeyName forKey:classKey];
+            [mutableClassSQL setObject:[[FCModelClassSQL alloc] initWithTableName:tableName primaryKeyName:primaryKeyName fieldNames:fields.allKeys] forKey:classKey];
+            [mutableClassesByTableName setObject:classKey forKey:tableName];
+            if (primaryKeyIsRowID) [mutableRowIDPrimaryKeyClasses addObject:classKey];
+            if (class_getMethodImplementation(tableModelClass, fieldValuesInit) != class_getMethodImplementation(FCModel.class, fieldValuesInit)) {
+                [mutableFieldValuesInitClasses addObject:classKey];
+            }
+            NSArray *trackedFieldNames = [tableModelClass installChangeTrackingSettersWithFieldInfo:fields primaryKeyName:primaryKeyName];
+            if (trackedFieldNames) [mutableTrackedFieldNames setObject:trackedFieldNames forKey:classKey];
             [columnsRS close];
 
             if (ignoredFieldNames.count) mutableIgnoredFieldNames[tableName] = [ignoredFieldNames copy];
@@ -1116,23 +2741,56 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
         [tablesRS close];
     
         g_fieldInfo = [mutableFieldInfo copy];
+        [g_database setModelClassesByTableName:mutableClassesByTableName];
+        g_rowIDPrimaryKeyClasses = [mutableRowIDPrimaryKeyClasses copy];
+        g_fieldValuesInitClasses = [mutableFieldValuesInitClasses copy];
         g_ignoredFieldNames = [mutableIgnoredFieldNames copy];
-        g_primaryKeyFieldName = [mutablePrimaryKeyFieldName copy];        
+        g_primaryKeyFieldName = [mutablePrimaryKeyFieldName copy];
+        g_classSQL = [mutableClassSQL copy];
+        g_trackedFieldNames = [mutableTrackedFieldNames copy];
+
+        NSMutableDictionary *orderedFieldNames = [NSMutableDictionary dictionary];
+        NSMutableDictionary *fieldOrdinals = [NSMutableDictionary dictionary];
+        NSMutableDictionary *rowSnapshotKinds = [NSMutableDictionary dictionary];
+        [g_fieldInfo enumerateKeysAndObjectsUsingBlock:^(id classKey, NSDictionary *fields, BOOL *stop) {
+            NSArray *fieldNames = [fields.allKeys sortedArrayUsingSelector:@selector(compare:)];
+            NSMutableDictionary *ordinals = [NSMutableDictionary dictionaryWithCapacity:fieldNames.count];
+            NSMutableData *kinds = [NSMutableData dataWithLength:fieldNames.count];
+            [fieldNames enumerateObjectsUsingBlock:^(NSString *fieldName, NSUInteger idx, BOOL *stop) {
+                ordinals[fieldName] = @(idx);
+                ((FCModelRowSnapshotKind *) kinds.mutableBytes)[idx] = fcm_rowSnapshotKindForValueType(((FCModelFieldInfo *) fields[fieldName]).valueType);
+            }];
+            orderedFieldNames[classKey] = fieldNames;
+            fieldOrdinals[classKey] = [ordinals copy];
+            rowSnapshotKinds[classKey] = [kinds copy];
+        }];
+        g_orderedFieldNames = [orderedFieldNames copy];
+        g_fieldOrdinals = [fieldOrdinals copy];
+        g_rowSnapshotKinds = [rowSnapshotKinds copy];
 
-    }];
+    }]; });
 }
 
 + (void)closeDatabase
 {
-    fcm_onMainQueue(^{
+    fcm_onDatabaseQueue(^{
         if (g_database) {
+            [self flushGroupCommit];
             [g_database close];
             g_database = nil;
         }
     
         [FCModelCachedObject clearCache];
-        [g_instances removeAllObjects];
+        fcm_onInstancesQueue(^{ [g_instances removeAllObjects]; });
         g_primaryKeyFieldName = nil;
+        g_classSQL = nil;
+        [self removeChangeTrackingSetters];
+        g_orderedFieldNames = nil;
+        g_fieldOrdinals = nil;
+        g_rowSnapshotKinds = nil;
+        fcm_onInstancesQueue(^{ g_lastSequentialPrimaryKeys = nil; });
+        g_rowIDPrimaryKeyClasses = nil;
+        g_fieldValuesInitClasses = nil;
         g_fieldInfo = nil;
         g_ignoredFieldNames = nil;
     });
@@ -1143,7 +2801,8 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 + (void)inDatabaseSync:(void (^)(FMDatabase *db))block
 {
     checkForOpenDatabaseFatal(YES);
-    fcm_onMainQueue(^{
+    fcm_onDatabaseQueue(^{
+        [self flushGroupCommit];
         [g_database inDatabase:block];
     });
 }
@@ -1157,25 +2816,32 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
         block(db);
         g_database.isQueuingNotifications = NO;
         [g_database.enqueuedChangedFieldsByClass removeAllObjects];
+        [g_database.enqueuedKeyChangesByClass removeAllObjects];
     }];
 }
 
 - (BOOL)saveWithoutChangeNotifications:(void (^)(void))modificiationsBlock
 {
     __block BOOL success = NO;
-    fcm_onMainQueue(^{
+    fcm_onDatabaseQueue(^{
+        [self.class flushGroupCommit];
         g_database.isQueuingNotifications = YES;
         success = [self save:modificiationsBlock];
         g_database.isQueuingNotifications = NO;
         [g_database.enqueuedChangedFieldsByClass removeAllObjects];
+        [g_database.enqueuedKeyChangesByClass removeAllObjects];
     });
     return success;
 }
 
+// Doesn't flush an open group commit (as inDatabaseSync: would), and doesn't count it as a transaction
 + (BOOL)isInTransaction
 {
+    checkForOpenDatabaseFatal(YES);
     __block BOOL inTransaction = NO;
-    [self inDatabaseSync:^(FMDatabase *db) { inTransaction = db.inTransaction; }];
+    fcm_onDatabaseQueue(^{
+        [g_database inDatabase:^(FMDatabase *db) { inTransaction = db.inTransaction && ! g_database.isInGroupCommit; }];
+    });
     return inTransaction;
 }
 
@@ -1189,8 +2855,6 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
 
 + (void)performTransaction:(BOOL (^)(void))block
 {
-    __block NSDictionary *changedFieldsToNotify = nil;
-
     [self inDatabaseSync:^(FMDatabase *db) {
         if (db.inTransaction) [[NSException exceptionWithName:FCModelException reason:@"Cannot nest FCModel transactions" userInfo:nil] raise];
         [db beginTransaction];
@@ -1200,20 +2864,64 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
         if (commit) [db commit];
         else [db rollback];
         
-        g_database.isQueuingNotifications = NO;
-        changedFieldsToNotify = [g_database.enqueuedChangedFieldsByClass copy];
-        [g_database.enqueuedChangedFieldsByClass removeAllObjects];
-
         // Send notifications
-        [changedFieldsToNotify enumerateKeysAndObjectsUsingBlock:^(Class class, NSDictionary *changedFields, BOOL *stop) {
-            [NSNotificationCenter.defaultCenter postNotificationName:FCModelWillSendChangeNotification object:class userInfo:@{ FCModelChangedFieldsKey : changedFields }];
-        }];
-        [changedFieldsToNotify enumerateKeysAndObjectsUsingBlock:^(Class class, NSDictionary *changedFields, BOOL *stop) {
-            [NSNotificationCenter.defaultCenter postNotificationName:FCModelChangeNotification object:class userInfo:@{ FCModelChangedFieldsKey : changedFields }];
-        }];
+        fcm_postEnqueuedChangeNotifications();
+    }];
+}
+
+#pragma mark - Group commit
+
++ (void)setGroupCommitWindow:(NSTimeInterval)windowSeconds maxSaveCount:(NSUInteger)maxSaveCount
+{
+    if (windowSeconds <= 0) [self flushGroupCommit];
+    g_groupCommitWindow = MAX(0, windowSeconds);
+    g_groupCommitMaxSaveCount = maxSaveCount;
+}
+
+// Called from _save before writing. Joins the open group commit, or opens one if possible.
++ (void)beginGroupCommitIfPossibleInDatabase:(FMDatabase *)db
+{
+    if (g_groupCommitWindow <= 0 || g_database.isInGroupCommit || db.inTransaction || g_database.isQueuingNotifications) return;
+
+    if (! [db beginTransaction]) [self queryFailedInDatabase:db];
+    g_database.isInGroupCommit = YES;
+    g_database.isQueuingNotifications = YES;
+    g_database.groupCommitSaveCount = 0;
+
+    FCModelDatabase *database = g_database;
+    NSUInteger generation = database.groupCommitGeneration;
+    [database performAfterDelay:g_groupCommitWindow block:^{
+        if (g_database == database && database.groupCommitGeneration == generation) [FCModel flushGroupCommit];
     }];
 }
 
++ (void)groupCommitDidSave
+{
+    if (! g_database.isInGroupCommit) return;
+    g_database.groupCommitSaveCount++;
+    if (g_groupCommitMaxSaveCount && g_database.groupCommitSaveCount >= g_groupCommitMaxSaveCount) [self flushGroupCommit];
+}
+
++ (void)flushGroupCommit
+{
+    if (! g_database) return;
+
+    fcm_onDatabaseQueue(^{
+        if (! g_database.isInGroupCommit) return;
+        [g_database inDatabase:^(FMDatabase *db) {
+            g_database.isInGroupCommit = NO;
+            g_database.groupCommitSaveCount = 0;
+            g_database.groupCommitGeneration++;
+            queryProfileStart(@"COMMIT -- group");
+            BOOL success = [db commit];
+            queryProfileEnd();
+            if (! success) [self queryFailedInDatabase:db];
+        }];
+        
+        fcm_postEnqueuedChangeNotifications();
+    });
+}
+
 + (BOOL)vacuumIfPossible
 {
     if (! checkForOpenDatabaseFatal(NO)) return NO;
@@ -1230,7 +2938,31 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
     return success;
 }
 
+// Called by the update hook for each row changed by writes FCModel didn't make. Keys are known only if the rowid is the primary key.
++ (void)recordUpdateHookOperation:(int)operation rowID:(sqlite3_int64)rowid inKeyChangesByClass:(NSMutableDictionary *)keyChangesByClass
+{
+    FCModelKeyChanges *keyChanges = keyChangesByClass[self];
+    if (! keyChanges) keyChangesByClass[(id) self] = keyChanges = [FCModelKeyChanges new];
+    
+    if (! [g_rowIDPrimaryKeyClasses containsObject:self]) [keyChanges markIncomplete];
+    else [keyChanges recordChangeType:(operation == SQLITE_INSERT ? FCModelChangeTypeInsert : (operation == SQLITE_DELETE ? FCModelChangeTypeDelete : FCModelChangeTypeUpdate)) primaryKeyValue:@(rowid)];
+}
+
++ (void)enqueueUpdateHookOperation:(int)operation rowID:(sqlite3_int64)rowid
+{
+    // Queued notifications from the hook are all-fields, so the fields only need to be enqueued for the first row
+    if (! g_database.enqueuedChangedFieldsByClass[self]) g_database.enqueuedChangedFieldsByClass[(id) self] = [NSMutableSet setWithArray:self.databaseFieldNames];
+    [self recordUpdateHookOperation:operation rowID:rowid inKeyChangesByClass:g_database.enqueuedKeyChangesByClass];
+}
+
 + (void)postChangeNotificationWithChangedFields:(NSSet *)changedFields changedObject:(FCModel *)changedObject changeType:(FCModelChangeType)changeType priorFieldValues:(NSDictionary *)priorFieldValues
+{
+    [self postChangeNotificationWithChangedFields:changedFields changedObject:changedObject changeType:changeType priorFieldValues:priorFieldValues keyChanges:nil additionalUserInfo:nil];
+}
+
+// keyChanges are the rows changed (nil if unknown), reported in notifications without changedObject and kept while
+//  queued. additionalUserInfo is only sent in immediate notifications without changedObject.
++ (void)postChangeNotificationWithChangedFields:(NSSet *)changedFields changedObject:(FCModel *)changedObject changeType:(FCModelChangeType)changeType priorFieldValues:(NSDictionary *)priorFieldValues keyChanges:(FCModelKeyChanges *)keyChanges additionalUserInfo:(NSDictionary *)additionalUserInfo
 {
     if (! changedFields) changedFields = [NSSet setWithArray:self.class.databaseFieldNames];
 
@@ -1239,11 +2971,19 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
         NSMutableSet *changedFieldsForClass = g_database.enqueuedChangedFieldsByClass[class];
         if (changedFieldsForClass) [changedFieldsForClass unionSet:changedFields];
         else g_database.enqueuedChangedFieldsByClass[class] = [changedFields mutableCopy];
+        
+        FCModelKeyChanges *enqueuedKeyChanges = g_database.enqueuedKeyChangesByClass[class];
+        if (! enqueuedKeyChanges) g_database.enqueuedKeyChangesByClass[class] = enqueuedKeyChanges = [FCModelKeyChanges new];
+        if (changedObject && ! keyChanges) {
+            [enqueuedKeyChanges recordChangeType:(changeType == FCModelChangeTypeUnspecified ? FCModelChangeTypeUpdate : changeType) primaryKeyValue:changedObject.primaryKey];
+        } else {
+            [enqueuedKeyChanges addChanges:keyChanges];
+        }
     } else {
         // notify immediately
-        NSDictionary *userInfo =
-            changedObject ? (
-                changeType == FCModelChangeTypeUpdate && priorFieldValues ?
+        NSDictionary *userInfo;
+        if (changedObject) {
+            userInfo = changeType == FCModelChangeTypeUpdate && priorFieldValues ?
                 @{
                     FCModelChangedFieldsKey : changedFields,
                     FCModelChangeTypeKey : @(changeType),
@@ -1254,14 +2994,116 @@ static inline BOOL checkForOpenDatabaseFatal(BOOL fatal)
                     FCModelChangeTypeKey : @(changeType),
                     FCModelInstanceKey : changedObject,
                 }
-            ) : @{
+            ;
+        } else {
+            NSMutableDictionary *unspecifiedInstanceUserInfo = [NSMutableDictionary dictionaryWithDictionary:@{
                 FCModelChangedFieldsKey : changedFields,
-                FCModelChangeTypeKey : @(FCModelChangeTypeUnspecified)
-            }
-        ;
+                FCModelChangeTypeKey : @(FCModelChangeTypeUnspecified),
+            }];
+            [keyChanges addToUserInfo:unspecifiedInstanceUserInfo];
+            if (additionalUserInfo) [unspecifiedInstanceUserInfo addEntriesFromDictionary:additionalUserInfo];
+            userInfo = unspecifiedInstanceUserInfo;
+        }
         [NSNotificationCenter.defaultCenter postNotificationName:FCModelWillSendChangeNotification object:self userInfo:userInfo];
-        [NSNotificationCenter.defaultCenter postNotificationName:FCModelChangeNotification object:self userInfo:userInfo];
+        fcm_postChangeNotification(self, userInfo);
+    }
+}
+
+@end
+
+
+@interface FCModelCursor ()
+@property (nonatomic) Class modelClass;
+@property (nonatomic, copy) NSString *whereClause;
+@property (nonatomic, copy) NSArray *arguments;
+@property (nonatomic, copy) NSString *sortFieldName;
+@property (nonatomic) BOOL ascending;
+@property (nonatomic) NSUInteger pageSize;
+@property (nonatomic, copy) NSArray *firstKey; // [sort value, primary key] of the current page's first instance
+@property (nonatomic, copy) NSArray *lastKey;  // and its last instance
+@end
+
+@implementation FCModelCursor
+
+- (instancetype)initWithModelClass:(Class)modelClass where:(NSString *)queryAfterWHERE arguments:(NSArray *)arguments orderedBy:(NSString *)sortFieldName ascending:(BOOL)ascending pageSize:(NSUInteger)pageSize
+{
+    if ( (self = [super init]) ) {
+        NSString *pkName = [modelClass primaryKeyFieldName];
+        if (sortFieldName && ! [modelClass infoForFieldName:sortFieldName]) {
+            [[NSException exceptionWithName:FCModelException reason:[NSString stringWithFormat:@"%@ has no field named %@ to page by", NSStringFromClass(modelClass), sortFieldName] userInfo:nil] raise];
+        }
+
+        self.modelClass = modelClass;
+        self.whereClause = queryAfterWHERE.length ? queryAfterWHERE : nil;
+        self.arguments = arguments ?: @[];
+        self.sortFieldName = [sortFieldName isEqualToString:pkName] ? nil : sortFieldName;
+        self.ascending = ascending;
+        self.pageSize = MAX(1, pageSize);
+    }
+    return self;
+}
+
+- (void)reset
+{
+    self.firstKey = nil;
+    self.lastKey = nil;
+}
+
+- (NSArray *)keyForInstance:(FCModel *)instance
+{
+    id pkValue = instance.primaryKey ?: NSNull.null;
+    if (! _sortFieldName) return @[ pkValue ];
+    return @[ [instance databaseValueForFieldName:_sortFieldName] ?: NSNull.null, pkValue ];
+}
+
+// Fetches pageSize instances after (or before) the key, in display order
+- (NSArray *)pageFromKey:(NSArray *)key forward:(BOOL)forward
+{
+    NSString *pkName = [_modelClass primaryKeyFieldName];
+    NSString *columns = _sortFieldName ? [NSString stringWithFormat:@"\"%@\", \"%@\"", _sortFieldName, pkName] : [NSString stringWithFormat:@"\"%@\"", pkName];
+    BOOL ascendingQuery = (forward == _ascending);
+    NSString *direction = ascendingQuery ? @"ASC" : @"DESC";
+
+    NSMutableString *query = [NSMutableString stringWithString:(_whereClause ? [NSString stringWithFormat:@"(%@)", _whereClause] : @"1")];
+    NSMutableArray *arguments = [_arguments mutableCopy];
+    if (key && _sortFieldName && key[0] == NSNull.null) {
+        // A row-value comparison with NULL is NULL, so edges with NULL sort values are sought separately. SQLite sorts
+        //  NULLs first: ascending, the remaining NULLs come next and then every non-NULL value; descending, only NULLs.
+        [query appendFormat:@" AND ((\"%@\" IS NULL AND \"%@\" %@ ?)%@)", _sortFieldName, pkName, (ascendingQuery ? @">" : @"<"), (ascendingQuery ? [NSString stringWithFormat:@" OR \"%@\" IS NOT NULL", _sortFieldName] : @"")];
+        [arguments addObject:key[1]];
+    } else if (key) {
+        // Rows with NULL sort values never satisfy the comparison, which only matters descending, where they come last
+        [query appendFormat:@" AND ((%@) %@ (%@)%@)", columns, (ascendingQuery ? @">" : @"<"), (_sortFieldName ? @"?, ?" : @"?"), (_sortFieldName && ! ascendingQuery ? [NSString stringWithFormat:@" OR \"%@\" IS NULL", _sortFieldName] : @"")];
+        [arguments addObjectsFromArray:key];
+    }
+    
+    if (_sortFieldName) [query appendFormat:@" ORDER BY \"%@\" %@, \"%@\" %@", _sortFieldName, direction, pkName, direction];
+    else [query appendFormat:@" ORDER BY \"%@\" %@", pkName, direction];
+    [query appendFormat:@" LIMIT %lu", (unsigned long) _pageSize];
+
+    NSArray *instances = [_modelClass instancesWhere:query arguments:arguments] ?: @[];
+    return forward ? instances : instances.reverseObjectEnumerator.allObjects;
+}
+
+- (NSArray *)nextPage
+{
+    NSArray *page = [self pageFromKey:_lastKey forward:YES];
+    if (page.count) {
+        self.firstKey = [self keyForInstance:page.firstObject];
+        self.lastKey = [self keyForInstance:page.lastObject];
+    }
+    return page;
+}
+
+- (NSArray *)previousPage
+{
+    if (! _firstKey) return @[];
+    NSArray *page = [self pageFromKey:_firstKey forward:NO];
+    if (page.count) {
+        self.firstKey = [self keyForInstance:page.firstObject];
+        self.lastKey = [self keyForInstance:page.lastObject];
     }
+    return page;
 }
 
 @end
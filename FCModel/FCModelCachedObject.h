@@ -11,10 +11,24 @@
 
 + (instancetype)objectWithModelClass:(Class)fcModelClass cacheIdentifier:(id)identifier ignoreFieldsForInvalidation:(NSSet *)ignoredFields generator:(id (^)(void))generatorBlock;
 
+// cost counts toward cacheCostLimit. If 0, it's estimated from the generated value: the element count of arrays, sets,
+//  and dictionaries, or 1 for anything else.
++ (instancetype)objectWithModelClass:(Class)fcModelClass cacheIdentifier:(id)identifier ignoreFieldsForInvalidation:(NSSet *)ignoredFields cost:(NSUInteger)cost generator:(id (^)(void))generatorBlock;
+
 @property (readonly) id value;
 
 + (void)clearCache;
 
+// When the total cost of all cached objects exceeds this limit, the least recently used are removed from the cache.
+//  Default is 0, for no limit.
++ (NSUInteger)cacheCostLimit;
++ (void)setCacheCostLimit:(NSUInteger)costLimit;
++ (NSUInteger)cacheTotalCost;
+
+// Removes the least recently used cached objects until their total cost is within cost. Call under memory pressure on
+//  platforms without UIKit memory warnings or dispatch memory-pressure events, which FCModel handles itself.
++ (void)trimCacheToCost:(NSUInteger)cost;
+
 @end
 
 
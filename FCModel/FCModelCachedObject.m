@@ -16,16 +16,168 @@
 //  so it can remove stale data before any application actions fetch new data in response to the change.
 extern NSString * const FCModelWillSendChangeNotification;
 
+// defined in FCModel.m
+extern BOOL fcm_isOnDatabaseQueue(void);
+extern NSSet *fcm_primaryKeysChangedByNotification(NSNotification *n);
+
+@interface FCModel ()
++ (NSSet *)fieldNamesReadByQueryAfterWHERE:(NSString *)queryAfterWHERE;
++ (BOOL)splitQueryAfterWHERE:(NSString *)queryAfterWHERE conditions:(out NSString **)outConditions sortDescriptors:(out NSArray **)outSortDescriptors;
+- (id)databaseValueForFieldName:(NSString *)fieldName;
+@end
+
+// Beyond this many changed rows since the last access, a cached result is regenerated instead of updated incrementally
+static const NSUInteger FCModelCachedObjectMaxPendingKeys = 1000;
+
+#pragma mark - Cache keys
+
+// Wraps a cache identifier with a hash computed once over its contents. NSArray's hash is just its count, so the
+//  [query, arguments] identifiers of cached queries would otherwise all share a hash.
+@interface FCModelCacheKey : NSObject <NSCopying>
+@property (nonatomic, readonly) id identifier;
++ (instancetype)keyWithIdentifier:(id)identifier;
+@end
+
+static const uint64_t FCModelCacheKeyFNVOffsetBasis = 14695981039346656037ULL;
+static const uint64_t FCModelCacheKeyFNVPrime = 1099511628211ULL;
+
+// 64-bit FNV-1a
+static uint64_t fcm_hashBytes(uint64_t hash, const void *bytes, size_t length)
+{
+    const uint8_t *byte = bytes;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= byte[i];
+        hash *= FCModelCacheKeyFNVPrime;
+    }
+    return hash;
+}
+
+// Consistent with isEqual: strings and data hash their full contents, arrays their elements, and others their own -hash
+static uint64_t fcm_hashCacheKeyComponent(uint64_t hash, id component)
+{
+    if ([component isKindOfClass:NSString.class]) {
+        NSString *string = component;
+        NSUInteger length = string.length;
+        unichar characters[256];
+        for (NSUInteger location = 0; location < length; location += 256) {
+            NSRange range = NSMakeRange(location, MIN(length - location, 256));
+            [string getCharacters:characters range:range];
+            hash = fcm_hashBytes(hash, characters, range.length * sizeof(unichar));
+        }
+        return fcm_hashBytes(hash, &length, sizeof(length));
+    }
+    
+    if ([component isKindOfClass:NSData.class]) {
+        NSData *data = component;
+        NSUInteger length = data.length;
+        return fcm_hashBytes(fcm_hashBytes(hash, data.bytes, length), &length, sizeof(length));
+    }
+    
+    if ([component isKindOfClass:NSArray.class]) {
+        NSUInteger count = [component count];
+        for (id element in component) hash = fcm_hashCacheKeyComponent(hash, element);
+        return fcm_hashBytes(hash, &count, sizeof(count));
+    }
+
+    NSUInteger componentHash = [component hash];
+    return fcm_hashBytes(hash, &componentHash, sizeof(componentHash));
+}
+
+@implementation FCModelCacheKey {
+    NSUInteger _hash;
+}
+
++ (instancetype)keyWithIdentifier:(id)identifier
+{
+    FCModelCacheKey *key = [self new];
+    key->_identifier = [identifier conformsToProtocol:@protocol(NSCopying)] ? [identifier copy] : identifier;
+    key->_hash = (NSUInteger) fcm_hashCacheKeyComponent(FCModelCacheKeyFNVOffsetBasis, key->_identifier);
+    return key;
+}
+
+- (id)copyWithZone:(NSZone *)zone { return self; }
+
+- (NSUInteger)hash { return _hash; }
+
+- (BOOL)isEqual:(id)object
+{
+    if (object == self) return YES;
+    if (! [object isKindOfClass:FCModelCacheKey.class]) return NO;
+    FCModelCacheKey *key = object;
+    return _hash == key->_hash && [_identifier isEqual:key->_identifier];
+}
+
+@end
+
+
+// One run of a cached object's generator, which other threads needing the value wait for instead of running their own
+@interface FCModelCachedObjectGeneration : NSObject
+@property (nonatomic) dispatch_group_t group;
+@property (nonatomic) NSThread *thread;
+@property (nonatomic) id result;
+@end
+
+@implementation FCModelCachedObjectGeneration
+@end
+
+
+// currentResult, currentResultIsValid, pendingChangedKeys, invalidationCount, and inFlightGeneration are accessed while
+//  @synchronized on the object, which is never held while generating
+@interface FCModelCachedObject ()
+
+@property (nonatomic) Class modelClass;
+@property (nonatomic, copy) id (^generator)(void);
+@property (nonatomic) BOOL currentResultIsValid;
+@property (nonatomic) id currentResult;
+@property (nonatomic) NSSet *ignoredFieldsForInvalidation;
+@property (nonatomic) NSSet *readFields; // if set, updates to only other fields can't change the result
+
+// If set, changes to known rows are collected in pendingChangedKeys and applied by calling this on the next access,
+//  instead of regenerating. It returns the updated result, or nil to regenerate.
+@property (nonatomic, copy) id (^incrementalUpdater)(id currentResult, NSSet *changedPrimaryKeys);
+@property (nonatomic) NSMutableSet *pendingChangedKeys;
+@property (nonatomic) NSUInteger invalidationCount;
+@property (nonatomic) FCModelCachedObjectGeneration *inFlightGeneration;
+
+// Managed by FCModelGeneratedObjectCache on its queue: the object's place in the least-recently-used list of all cached
+//  objects, and its cost toward the cache's limit
+@property (nonatomic) FCModelCacheKey *cacheKey;
+@property (nonatomic) BOOL isCached;
+@property (nonatomic, unsafe_unretained) FCModelCachedObject *lessRecentlyUsed;
+@property (nonatomic, unsafe_unretained) FCModelCachedObject *moreRecentlyUsed;
+@property (nonatomic) NSUInteger cost;
+@property (nonatomic) NSUInteger fixedCost; // caller-provided, or 0 to estimate from the value
+
+- (void)discardValue;
+
+// configurationBlock is only called if a new object is created
++ (instancetype)objectWithModelClass:(Class)fcModelClass cacheIdentifier:(id)identifier ignoreFieldsForInvalidation:(NSSet *)ignoredFields configuration:(void (^)(FCModelCachedObject *obj))configurationBlock generator:(id (^)(void))generatorBlock;
+
+@end
+
 #pragma mark - Global cache
 
+// Cached objects are kept in a least-recently-used list across all classes. When their total cost exceeds costLimit,
+//  the least recently used are removed from the cache and their values released.
+// cacheQueue is concurrent: lookups run in parallel with dispatch_sync, and changes use dispatch_barrier_sync.
 @interface FCModelGeneratedObjectCache : NSObject
 @property (nonatomic) NSMutableDictionary *cache;
 @property (nonatomic) dispatch_queue_t cacheQueue;
+@property (nonatomic) NSUInteger costLimit; // 0 for no limit
+@property (nonatomic) NSUInteger totalCost;
+@property (nonatomic, unsafe_unretained) FCModelCachedObject *mostRecentlyUsed;
+@property (nonatomic, unsafe_unretained) FCModelCachedObject *leastRecentlyUsed;
+#if !(TARGET_OS_IPHONE && ! TARGET_OS_WATCH) && defined(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE)
+@property (nonatomic) dispatch_source_t memoryPressureSource;
+#endif
 
 + (instancetype)sharedInstance;
 - (void)clear:(id)sender;
-- (FCModelCachedObject *)objectWithModelClass:(Class)fcModelClass identifier:(id)identifier;
-- (void)saveObject:(FCModelCachedObject *)obj class:(Class)fcModelClass identifier:(id)identifier;
+- (void)trimToCost:(NSUInteger)cost;
+- (void)trimToHalfCost;
+- (FCModelCachedObject *)objectWithModelClass:(Class)fcModelClass key:(FCModelCacheKey *)key;
+- (FCModelCachedObject *)addObject:(FCModelCachedObject *)obj class:(Class)fcModelClass key:(FCModelCacheKey *)key; // returns the existing object if there is one
+- (void)updateObject:(FCModelCachedObject *)obj cost:(NSUInteger)cost used:(BOOL)used;
 
 @end
 
@@ -44,10 +196,20 @@ extern NSString * const FCModelWillSendChangeNotification;
 - (instancetype)init
 {
     if ( (self = [super init]) ) {
-        self.cacheQueue = dispatch_queue_create("FCModelGeneratedObjectCache", NULL);
+        self.cacheQueue = dispatch_queue_create("FCModelGeneratedObjectCache", DISPATCH_QUEUE_CONCURRENT);
         self.cache = [NSMutableDictionary dictionary];
 #if TARGET_OS_IPHONE && ! TARGET_OS_WATCH
         [NSNotificationCenter.defaultCenter addObserver:self selector:@selector(clear:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+#endif
+#if !(TARGET_OS_IPHONE && ! TARGET_OS_WATCH) && defined(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE)
+        __weak typeof(self) weakSelf = self;
+        self.memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, dispatch_get_main_queue());
+        dispatch_source_set_event_handler(self.memoryPressureSource, ^{
+            FCModelGeneratedObjectCache *strongSelf = weakSelf;
+            if (dispatch_source_get_data(strongSelf.memoryPressureSource) & DISPATCH_MEMORYPRESSURE_CRITICAL) [strongSelf clear:nil];
+            else [strongSelf trimToHalfCost];
+        });
+        dispatch_resume(self.memoryPressureSource);
 #endif
     }
     return self;
@@ -56,36 +218,132 @@ extern NSString * const FCModelWillSendChangeNotification;
 - (void)dealloc
 {
     [NSNotificationCenter.defaultCenter removeObserver:self];
+#if !(TARGET_OS_IPHONE && ! TARGET_OS_WATCH) && defined(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE)
+    dispatch_source_cancel(self.memoryPressureSource);
+#endif
     [self clear:nil];
 }
 
 - (void)clear:(id)sender
 {
-    dispatch_sync(self.cacheQueue, ^{
+    dispatch_barrier_sync(self.cacheQueue, ^{
+        for (FCModelCachedObject *obj = self.mostRecentlyUsed; obj; ) {
+            FCModelCachedObject *next = obj.lessRecentlyUsed;
+            obj.lessRecentlyUsed = obj.moreRecentlyUsed = nil;
+            obj.isCached = NO;
+            obj = next;
+        }
+        self.mostRecentlyUsed = self.leastRecentlyUsed = nil;
+        self.totalCost = 0;
         [self.cache removeAllObjects];
     });
 }
 
-- (void)saveObject:(FCModelCachedObject *)obj class:(Class)fcModelClass identifier:(id)identifier
+- (void)setCostLimit:(NSUInteger)costLimit
 {
-    dispatch_sync(self.cacheQueue, ^{
+    dispatch_barrier_sync(self.cacheQueue, ^{
+        _costLimit = costLimit;
+        if (costLimit) [self evictToCost:costLimit keeping:nil];
+    });
+}
+
+- (void)trimToCost:(NSUInteger)cost
+{
+    dispatch_barrier_sync(self.cacheQueue, ^{ [self evictToCost:cost keeping:nil]; });
+}
+
+- (void)trimToHalfCost
+{
+    dispatch_barrier_sync(self.cacheQueue, ^{ [self evictToCost:self.totalCost / 2 keeping:nil]; });
+}
+
+// In a barrier on cacheQueue: removes the least recently used objects other than keptObject until the total is within cost
+- (void)evictToCost:(NSUInteger)cost keeping:(FCModelCachedObject *)keptObject
+{
+    FCModelCachedObject *obj = self.leastRecentlyUsed;
+    while (obj && self.totalCost > cost) {
+        FCModelCachedObject *moreRecentlyUsed = obj.moreRecentlyUsed;
+        if (obj != keptObject) {
+            [self.cache[obj.modelClass] removeObjectForKey:obj.cacheKey];
+            [self unlinkObject:obj];
+            obj.isCached = NO;
+            self.totalCost -= obj.cost;
+            [obj discardValue];
+        }
+        obj = moreRecentlyUsed;
+    }
+}
+
+// In a barrier on cacheQueue
+- (void)unlinkObject:(FCModelCachedObject *)obj
+{
+    if (obj.lessRecentlyUsed) obj.lessRecentlyUsed.moreRecentlyUsed = obj.moreRecentlyUsed;
+    else self.leastRecentlyUsed = obj.moreRecentlyUsed;
+    if (obj.moreRecentlyUsed) obj.moreRecentlyUsed.lessRecentlyUsed = obj.lessRecentlyUsed;
+    else self.mostRecentlyUsed = obj.lessRecentlyUsed;
+    obj.lessRecentlyUsed = obj.moreRecentlyUsed = nil;
+}
+
+// In a barrier on cacheQueue
+- (void)linkObjectAsMostRecentlyUsed:(FCModelCachedObject *)obj
+{
+    obj.lessRecentlyUsed = self.mostRecentlyUsed;
+    if (self.mostRecentlyUsed) self.mostRecentlyUsed.moreRecentlyUsed = obj;
+    else self.leastRecentlyUsed = obj;
+    self.mostRecentlyUsed = obj;
+}
+
+- (void)updateObject:(FCModelCachedObject *)obj cost:(NSUInteger)cost used:(BOOL)used
+{
+    // Repeated use of the most recently used object, e.g. by many threads at once, only needs the shared lookup
+    __block BOOL changed = NO;
+    dispatch_sync(self.cacheQueue, ^{ changed = obj.isCached && (obj.cost != cost || (used && self.mostRecentlyUsed != obj)); });
+    if (! changed) return;
+
+    dispatch_barrier_sync(self.cacheQueue, ^{
+        if (! obj.isCached) return;
+        if (used && self.mostRecentlyUsed != obj) {
+            [self unlinkObject:obj];
+            [self linkObjectAsMostRecentlyUsed:obj];
+        }
+        self.totalCost = self.totalCost - obj.cost + cost;
+        obj.cost = cost;
+        if (_costLimit) [self evictToCost:_costLimit keeping:obj];
+    });
+}
+
+- (FCModelCachedObject *)addObject:(FCModelCachedObject *)obj class:(Class)fcModelClass key:(FCModelCacheKey *)key
+{
+    __block FCModelCachedObject *result = obj;
+    dispatch_barrier_sync(self.cacheQueue, ^{
         NSMutableDictionary *classCache = self.cache[fcModelClass];
         if (! classCache) {
             classCache = [NSMutableDictionary dictionary];
             self.cache[(id)fcModelClass] = classCache;
         }
         
-        classCache[identifier] = obj;
+        // Another thread may have added one since this thread's lookup
+        FCModelCachedObject *existingObj = classCache[key];
+        if (existingObj) { result = existingObj; return; }
+
+        classCache[key] = obj;
+        obj.cacheKey = key;
+        obj.isCached = YES;
+        obj.cost = 1;
+        self.totalCost += obj.cost;
+        [self linkObjectAsMostRecentlyUsed:obj];
+        if (_costLimit) [self evictToCost:_costLimit keeping:obj];
     });
+    return result;
 }
 
-- (FCModelCachedObject *)objectWithModelClass:(Class)fcModelClass identifier:(id)identifier
+- (FCModelCachedObject *)objectWithModelClass:(Class)fcModelClass key:(FCModelCacheKey *)key
 {
     __block FCModelCachedObject *result = nil;
     dispatch_sync(self.cacheQueue, ^{
         NSMutableDictionary *classCache = self.cache[fcModelClass];
         if (! classCache) return;
-        result = classCache[identifier];
+        result = classCache[key];
     });
     return result;
 }
@@ -95,16 +353,6 @@ extern NSString * const FCModelWillSendChangeNotification;
 
 #pragma mark - FCModelCachedObject
 
-@interface FCModelCachedObject ()
-
-@property (nonatomic) Class modelClass;
-@property (nonatomic, copy) id (^generator)(void);
-@property (nonatomic) BOOL currentResultIsValid;
-@property (nonatomic) id currentResult;
-@property (nonatomic) NSSet *ignoredFieldsForInvalidation;
-
-@end
-
 @implementation FCModelCachedObject
 
 + (void)clearCache
@@ -112,6 +360,22 @@ extern NSString * const FCModelWillSendChangeNotification;
     [FCModelGeneratedObjectCache.sharedInstance clear:nil];
 }
 
++ (NSUInteger)cacheCostLimit { return FCModelGeneratedObjectCache.sharedInstance.costLimit; }
++ (void)setCacheCostLimit:(NSUInteger)costLimit { FCModelGeneratedObjectCache.sharedInstance.costLimit = costLimit; }
+
++ (NSUInteger)cacheTotalCost
+{
+    FCModelGeneratedObjectCache *cache = FCModelGeneratedObjectCache.sharedInstance;
+    __block NSUInteger totalCost;
+    dispatch_sync(cache.cacheQueue, ^{ totalCost = cache.totalCost; });
+    return totalCost;
+}
+
++ (void)trimCacheToCost:(NSUInteger)cost
+{
+    [FCModelGeneratedObjectCache.sharedInstance trimToCost:cost];
+}
+
 + (instancetype)objectWithModelClass:(Class)fcModelClass cacheIdentifier:(id)identifier generator:(id (^)(void))generatorBlock
 {
     return [self objectWithModelClass:fcModelClass cacheIdentifier:identifier ignoreFieldsForInvalidation:nil generator:generatorBlock];
@@ -119,21 +383,37 @@ extern NSString * const FCModelWillSendChangeNotification;
 
 + (instancetype)objectWithModelClass:(Class)fcModelClass cacheIdentifier:(id)identifier ignoreFieldsForInvalidation:(NSSet *)ignoredFields generator:(id (^)(void))generatorBlock
 {
-    FCModelCachedObject *obj = [FCModelGeneratedObjectCache.sharedInstance objectWithModelClass:fcModelClass identifier:identifier];
+    return [self objectWithModelClass:fcModelClass cacheIdentifier:identifier ignoreFieldsForInvalidation:ignoredFields configuration:nil generator:generatorBlock];
+}
+
++ (instancetype)objectWithModelClass:(Class)fcModelClass cacheIdentifier:(id)identifier ignoreFieldsForInvalidation:(NSSet *)ignoredFields cost:(NSUInteger)cost generator:(id (^)(void))generatorBlock
+{
+    return [self objectWithModelClass:fcModelClass cacheIdentifier:identifier ignoreFieldsForInvalidation:ignoredFields configuration:^(FCModelCachedObject *obj) {
+        obj.fixedCost = cost;
+    } generator:generatorBlock];
+}
+
++ (instancetype)objectWithModelClass:(Class)fcModelClass cacheIdentifier:(id)identifier ignoreFieldsForInvalidation:(NSSet *)ignoredFields configuration:(void (^)(FCModelCachedObject *obj))configurationBlock generator:(id (^)(void))generatorBlock
+{
+    FCModelCacheKey *key = [FCModelCacheKey keyWithIdentifier:identifier];
+    FCModelCachedObject *obj = [FCModelGeneratedObjectCache.sharedInstance objectWithModelClass:fcModelClass key:key];
 
     if (! obj) {
-        obj = [[FCModelCachedObject alloc] init];
-        obj.modelClass = fcModelClass;
-        obj.generator = generatorBlock;
-        obj.ignoredFieldsForInvalidation = ignoredFields;
+        FCModelCachedObject *newObj = [[FCModelCachedObject alloc] init];
+        newObj.modelClass = fcModelClass;
+        newObj.generator = generatorBlock;
+        newObj.ignoredFieldsForInvalidation = ignoredFields;
+        if (configurationBlock) configurationBlock(newObj);
+
+        // If another thread added one for this identifier in the meantime, use that so they share its value
+        obj = [FCModelGeneratedObjectCache.sharedInstance addObject:newObj class:fcModelClass key:key];
+        if (obj != newObj) return obj;
 
         [NSNotificationCenter.defaultCenter addObserver:obj selector:@selector(dataSourceChanged:) name:FCModelWillSendChangeNotification object:fcModelClass];
 
 #if TARGET_OS_IPHONE && ! TARGET_OS_WATCH
         [NSNotificationCenter.defaultCenter addObserver:obj selector:@selector(flush:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
 #endif
-
-        [FCModelGeneratedObjectCache.sharedInstance saveObject:obj class:fcModelClass identifier:identifier];
     }
     return obj;
 }
@@ -144,29 +424,123 @@ extern NSString * const FCModelWillSendChangeNotification;
 {
     if (n.object != nil && n.object != self.modelClass) return;
     
-    NSSet *changedFields, *ignoredFields = self.ignoredFieldsForInvalidation;
-    if (ignoredFields && (changedFields = n.userInfo[FCModelChangedFieldsKey]) ) {
+    NSSet *changedFields = n.userInfo[FCModelChangedFieldsKey], *ignoredFields = self.ignoredFieldsForInvalidation;
+    if (ignoredFields && changedFields) {
         NSMutableSet *fieldsWeCareAbout = [changedFields mutableCopy];
         [fieldsWeCareAbout minusSet:ignoredFields];
         if (fieldsWeCareAbout.count == 0) return;
+        changedFields = fieldsWeCareAbout;
+    }
+    
+    // Only a notification for an instance saved through FCModel reliably lists its changed fields, and leaves loaded
+    //  instances already up to date. Others (e.g. from raw SQL or the update hook) may not, even if their fields miss readFields.
+    if (
+        self.readFields && changedFields && n.userInfo[FCModelInstanceKey] &&
+        ! [self.class changeMayAddOrRemoveRows:n] && ! [self.readFields intersectsSet:changedFields]
+    ) return;
+    
+    NSSet *changedKeys = self.incrementalUpdater ? fcm_primaryKeysChangedByNotification(n) : nil;
+    if (changedKeys) {
+        @synchronized (self) {
+            if (self.currentResultIsValid) {
+                if (! self.pendingChangedKeys) self.pendingChangedKeys = [NSMutableSet set];
+                [self.pendingChangedKeys unionSet:changedKeys];
+                if (self.pendingChangedKeys.count <= FCModelCachedObjectMaxPendingKeys) return;
+            }
+        }
     }
     
     [self flush:n];
 }
 
++ (BOOL)changeMayAddOrRemoveRows:(NSNotification *)n
+{
+    FCModelChangeType changeType = [n.userInfo[FCModelChangeTypeKey] integerValue];
+    if (changeType == FCModelChangeTypeUpdate) return NO;
+    if (changeType == FCModelChangeTypeInsert || changeType == FCModelChangeTypeDelete) return YES;
+
+    NSSet *insertedKeys = n.userInfo[FCModelInsertedPrimaryKeyValuesKey], *deletedKeys = n.userInfo[FCModelDeletedPrimaryKeyValuesKey];
+    return ! insertedKeys || ! deletedKeys || insertedKeys.count || deletedKeys.count;
+}
+
 - (void)flush:(NSNotification *)n
 {
-    self.currentResult = nil;
-    self.currentResultIsValid = NO;
+    [self discardValue];
+    [FCModelGeneratedObjectCache.sharedInstance updateObject:self cost:1 used:NO];
 }
 
+- (void)discardValue
+{
+    @synchronized (self) {
+        self.currentResult = nil;
+        self.currentResultIsValid = NO;
+        self.pendingChangedKeys = nil;
+        self.invalidationCount++;
+    }
+}
+
+// Collections cost their element count, anything else 1, unless the caller provided a cost
+- (NSUInteger)costOfValue:(id)value
+{
+    if (self.fixedCost) return self.fixedCost;
+    NSUInteger count = [value respondsToSelector:@selector(count)] ? [(NSArray *) value count] : 1;
+    return MAX(count, 1);
+}
+
+// Only one thread at a time runs the generator (or applies pending changes), and others wait for its result. The
+//  exception is the database queue, which never waits, since the generator's queries may need it.
 - (id)value
 {
-    if (! self.currentResultIsValid) {
-        self.currentResult = self.generator();
-        self.currentResultIsValid = YES;
+    BOOL isCurrent = NO;
+    id result = nil, previousResult = nil;
+    NSSet *changedKeys = nil;
+    NSUInteger invalidationCount = 0;
+    FCModelCachedObjectGeneration *generation = nil, *otherThreadsGeneration = nil;
+
+    @synchronized (self) {
+        if (self.currentResultIsValid && ! self.pendingChangedKeys.count) {
+            isCurrent = YES;
+            result = self.currentResult;
+        } else if (self.inFlightGeneration && ! fcm_isOnDatabaseQueue() && self.inFlightGeneration.thread != NSThread.currentThread) {
+            otherThreadsGeneration = self.inFlightGeneration;
+        } else {
+            // Includes a generator reading this object's value, which would wait for itself, so it generates again inline
+            generation = [FCModelCachedObjectGeneration new];
+            generation.thread = NSThread.currentThread;
+            generation.group = dispatch_group_create();
+            dispatch_group_enter(generation.group);
+            if (! self.inFlightGeneration) self.inFlightGeneration = generation;
+            
+            if (self.currentResultIsValid) {
+                previousResult = self.currentResult;
+                changedKeys = self.pendingChangedKeys;
+                self.pendingChangedKeys = nil;
+            }
+            invalidationCount = self.invalidationCount;
+        }
     }
-    return self.currentResult;
+
+    if (otherThreadsGeneration) {
+        dispatch_group_wait(otherThreadsGeneration.group, DISPATCH_TIME_FOREVER);
+        result = otherThreadsGeneration.result;
+    } else if (! isCurrent) {
+        if (changedKeys) result = self.incrementalUpdater(previousResult, changedKeys);
+        if (! result) result = self.generator();
+        
+        @synchronized (self) {
+            // Changes that arrived while generating invalidated this result, but the callers waiting for it still get it
+            if (self.invalidationCount == invalidationCount) {
+                self.currentResult = result;
+                self.currentResultIsValid = YES;
+            }
+            if (self.inFlightGeneration == generation) self.inFlightGeneration = nil;
+        }
+        generation.result = result;
+        dispatch_group_leave(generation.group);
+    }
+
+    [FCModelGeneratedObjectCache.sharedInstance updateObject:self cost:[self costOfValue:result] used:YES];
+    return result;
 }
 
 @end
@@ -175,6 +549,23 @@ extern NSString * const FCModelWillSendChangeNotification;
 
 #pragma mark - FCModelLiveResultArray
 
+// Orders instances by sortDescriptors' fields the way SQLite does, with NULLs first in ascending order. Compares their
+//  database values, since unsaved changes don't affect where SQLite would place their rows.
+static NSComparisonResult fcm_compareInstances(FCModel *a, FCModel *b, NSArray *sortDescriptors)
+{
+    for (NSSortDescriptor *sortDescriptor in sortDescriptors) {
+        id aValue = [a databaseValueForFieldName:sortDescriptor.key], bValue = [b databaseValueForFieldName:sortDescriptor.key];
+
+        NSComparisonResult result;
+        if (! aValue || ! bValue) result = (aValue ? NSOrderedDescending : (bValue ? NSOrderedAscending : NSOrderedSame));
+        else if ([aValue isKindOfClass:NSString.class]) result = [aValue compare:bValue options:NSLiteralSearch];
+        else result = [aValue compare:bValue];
+
+        if (result != NSOrderedSame) return sortDescriptor.ascending ? result : (NSComparisonResult) -result;
+    }
+    return NSOrderedSame;
+}
+
 @interface FCModelLiveResultArray ()
 @property (nonatomic) FCModelCachedObject *cachedObject;
 @end
@@ -185,13 +576,54 @@ extern NSString * const FCModelWillSendChangeNotification;
 {
     FCModelLiveResultArray *set = [self new];
     
-    set.cachedObject = [FCModelCachedObject objectWithModelClass:fcModelClass cacheIdentifier:@[(query ?: NSNull.null), (arguments ?: NSNull.null)] ignoreFieldsForInvalidation:ignoredFields generator:^id{
+    // The array holds the unique loaded instances, which are updated in place, so it only goes stale if rows are
+    //  inserted or deleted, or if an update changes a field that the query filters or sorts by.
+    set.cachedObject = [FCModelCachedObject objectWithModelClass:fcModelClass cacheIdentifier:@[(query ?: NSNull.null), (arguments ?: NSNull.null)] ignoreFieldsForInvalidation:ignoredFields configuration:^(FCModelCachedObject *obj) {
+        obj.readFields = [fcModelClass fieldNamesReadByQueryAfterWHERE:query];
+
+        NSString *conditions;
+        NSArray *sortDescriptors;
+        if ([fcModelClass splitQueryAfterWHERE:query conditions:&conditions sortDescriptors:&sortDescriptors]) {
+            obj.incrementalUpdater = ^id(NSArray *currentResult, NSSet *changedKeys) {
+                return [self arrayByUpdatingArray:currentResult modelClass:fcModelClass changedPrimaryKeys:changedKeys conditions:conditions arguments:arguments sortDescriptors:sortDescriptors];
+            };
+        }
+    } generator:^id{
         return query ? [fcModelClass instancesWhere:query arguments:arguments] : [fcModelClass allInstances];
     }];
 
     return set;
 }
 
+// Re-checks only the changed rows against the query's conditions, then splices them out of the array and back in at
+//  their sorted positions, or where they were if the query has no ORDER BY.
++ (NSArray *)arrayByUpdatingArray:(NSArray *)currentResult modelClass:(Class)fcModelClass changedPrimaryKeys:(NSSet *)changedKeys conditions:(NSString *)conditions arguments:(NSArray *)arguments sortDescriptors:(NSArray *)sortDescriptors
+{
+    NSArray *matchingInstances = [fcModelClass instancesWherePrimaryKeyValueIn:changedKeys.allObjects andWhere:conditions arguments:arguments];
+    if (! matchingInstances) return nil;
+
+    NSMutableArray *result = [currentResult mutableCopy];
+    NSMutableSet *instancesToAdd = [NSMutableSet setWithArray:matchingInstances];
+    BOOL sorted = sortDescriptors.count > 0;
+    NSIndexSet *indexesToRemove = [result indexesOfObjectsPassingTest:^BOOL(FCModel *instance, NSUInteger idx, BOOL *stop) {
+        if (! [changedKeys containsObject:instance.primaryKey]) return NO;
+        if (! sorted && [instancesToAdd containsObject:instance]) { [instancesToAdd removeObject:instance]; return NO; }
+        return YES;
+    }];
+    [result removeObjectsAtIndexes:indexesToRemove];
+
+    for (FCModel *instance in matchingInstances) {
+        if (! [instancesToAdd containsObject:instance]) continue;
+        if (! sorted) { [result addObject:instance]; continue; }
+
+        NSUInteger index = [result indexOfObject:instance inSortedRange:NSMakeRange(0, result.count) options:NSBinarySearchingInsertionIndex | NSBinarySearchingLastEqual usingComparator:^NSComparisonResult(FCModel *a, FCModel *b) {
+            return fcm_compareInstances(a, b, sortDescriptors);
+        }];
+        [result insertObject:instance atIndex:index];
+    }
+    return result;
+}
+
 - (NSArray *)allObjects { return self.cachedObject.value; }
 
 @end
@@ -16,12 +16,70 @@
 @interface FCModelDatabase : NSObject
 
 - (instancetype)initWithDatabasePath:(NSString *)filename;
+- (instancetype)initWithDatabasePath:(NSString *)filename usingPrivateQueue:(BOOL)usePrivateQueue;
+- (instancetype)initWithDatabasePath:(NSString *)filename usingPrivateQueue:(BOOL)usePrivateQueue maxConcurrentReaders:(NSUInteger)readerCount;
 - (void)close;
 - (void)inDatabase:(void (^)(FMDatabase *db))block;
 
+// Run a block on the database's execution queue: the main queue by default, or a private serial queue if
+//  created with usingPrivateQueue:YES. Synchronous calls are reentrant.
+- (void)performSync:(void (^)(void))block;
+- (void)performAsync:(void (^)(void))block;
+- (void)performAfterDelay:(NSTimeInterval)delay block:(void (^)(void))block;
+- (BOOL)isOnDatabaseQueue;
+
+// For SELECTs only. If concurrent readers are enabled, runs the block synchronously on the calling thread with one of
+//  the read-only WAL connections. Otherwise, or if called from the database queue (so transactions see their own
+//  writes), or if all readers are busy, runs it on the database queue with the writer connection.
+- (void)inReadOnlyDatabase:(void (^)(FMDatabase *db))block;
+
+// Inside an inReadOnlyDatabase: block running on a concurrent reader, queues the block to run on the calling thread once
+//  the reader is back in its pool, and returns YES. Otherwise returns NO without running it. For work that can close the
+//  database, such as reporting a query failure, which can't be done while a reader is checked out.
+- (BOOL)performAfterReaderCheckIn:(void (^)(void))block;
+
+// Incremented after each commit on the writer while concurrent readers are enabled. readerWriteCount is its value when
+//  the calling thread's current read-only connection was checked out, or the current writeCount outside of one, so a
+//  reader can tell whether a write has committed since its snapshot began.
+@property (readonly) NSUInteger writeCount;
+- (NSUInteger)readerWriteCount;
+
+// Runs a block with a private read-only connection, opened on first use and serialized, for preparing statements only to
+//  inspect them, e.g. with an authorizer. Setting an authorizer expires every prepared statement on its connection, so
+//  it can't be done on the writer or readers without discarding their cached statements. Doesn't run the block if the
+//  database can't be opened by path (e.g. in-memory). The connection is set up with databaseInitializer when opened.
+- (void)inStatementAnalysisDatabase:(void (^)(sqlite3 *db))block;
+@property (nonatomic, copy) void (^databaseInitializer)(FMDatabase *db);
+
+// FMDB caches a prepared statement for every distinct SQL string a connection runs, without limit. Only the SQL added
+//  here (FCModel's fixed per-class statements) stays cached; statements for other SQL are discarded after the block
+//  that ran them in inDatabase: or inReadOnlyDatabase:.
+- (void)addCachedStatementSQL:(NSString *)sql;
+
 @property (nonatomic, readonly) FMDatabase *database;
+@property (nonatomic, readonly) BOOL usesPrivateQueue;
+@property (nonatomic, readonly) NSUInteger maxConcurrentReaders;
 @property (nonatomic, readonly) NSMutableDictionary *enqueuedChangedFieldsByClass;
+@property (nonatomic, readonly) NSMutableDictionary *enqueuedKeyChangesByClass; // the primary keys changed along with enqueuedChangedFieldsByClass
 @property (nonatomic) BOOL isQueuingNotifications;
 @property (nonatomic) BOOL isInInternalWrite;
 
+// During internal writes, the update hook sets lastInternalWriteOperation (if it's 0) to the first SQLITE_INSERT,
+//  SQLITE_UPDATE, or SQLITE_DELETE on internalWriteClass's table, so writes by triggers to other tables can't replace it
+@property (nonatomic) Class internalWriteClass;
+@property (nonatomic) int lastInternalWriteOperation;
+
+// While recording, the update hook collects the rowids of rows changed by other writes: class -> NSMutableSet of NSNumber
+//  rowids, or NSNull if there were too many to keep
+@property (nonatomic) BOOL isRecordingAffectedRowIDs;
+@property (nonatomic, readonly) NSMutableDictionary *affectedRowIDsByClass;
+
+// The update hook only reports changes to these tables, looked up without creating objects. Set by FCModel after reading the schema.
+- (void)setModelClassesByTableName:(NSDictionary *)classesByTableName;
+
+// Group-commit state, managed by FCModel: while a group commit is open, saves share one transaction with notifications queued
+@property (nonatomic) BOOL isInGroupCommit;
+@property (nonatomic) NSUInteger groupCommitSaveCount;
+@property (nonatomic) NSUInteger groupCommitGeneration;
+
 @end
@@ -9,74 +9,387 @@
 #import "FCModel.h"
 #import <sqlite3.h>
 
+#ifdef COCOAPODS
+#import <FMDB/FMDatabasePool.h>
+#else
+#import "FMDatabasePool.h"
+#endif
+
 // defined in FCModel.m
 extern void fcm_onMainQueue(void (^block)(void));
 
+@class FCModelKeyChanges;
+
 @interface FCModel ()
-+ (void)postChangeNotificationWithChangedFields:(NSSet *)changedFields changedObject:(FCModel *)changedObject changeType:(FCModelChangeType)changeType priorFieldValues:(NSDictionary *)priorFieldValues;
++ (void)postChangeNotificationWithChangedFields:(NSSet *)changedFields changedObject:(FCModel *)changedObject changeType:(FCModelChangeType)changeType priorFieldValues:(NSDictionary *)priorFieldValues keyChanges:(FCModelKeyChanges *)keyChanges additionalUserInfo:(NSDictionary *)additionalUserInfo;
++ (void)recordUpdateHookOperation:(int)operation rowID:(sqlite3_int64)rowid inKeyChangesByClass:(NSMutableDictionary *)keyChangesByClass;
++ (void)enqueueUpdateHookOperation:(int)operation rowID:(sqlite3_int64)rowid;
 @end
 
-static void _sqlite3_update_hook(void *context, int sqlite_operation, char const *db_name, char const *table_name, sqlite3_int64 rowid)
+// Keys for the table-name map, which the update hook looks up with SQLite's C-string table names. SQLite table names
+//  are case-insensitive, so the keys hash and compare ASCII-case-folded, without converting each name per row.
+static CFHashCode fcm_tableNameHash(const void *value)
 {
-    Class class = NSClassFromString([NSString stringWithCString:table_name encoding:NSUTF8StringEncoding]);
-    if (! class || ! [class isSubclassOfClass:FCModel.class]) return;
+    CFHashCode hash = 2166136261u; // FNV-1a
+    for (const unsigned char *c = value; *c; c++) hash = (hash ^ (CFHashCode) tolower(*c)) * 16777619u;
+    return hash;
+}
+
+static Boolean fcm_tableNameEqual(const void *value1, const void *value2) { return 0 == strcasecmp(value1, value2); }
+static const void *fcm_tableNameRetain(CFAllocatorRef allocator, const void *value) { return strdup(value); }
+static void fcm_tableNameRelease(CFAllocatorRef allocator, const void *value) { free((void *) value); }
+
+static const CFDictionaryKeyCallBacks FCModelTableNameKeyCallBacks = {
+    0, fcm_tableNameRetain, fcm_tableNameRelease, NULL, fcm_tableNameEqual, fcm_tableNameHash
+};
+
+static const NSUInteger FCModelMaxRecordedRowIDsPerClass = 10000;
+
+// rowIDsByClass values are NSMutableSets of rowids, or NSNull once a class has too many to keep
+static void fcm_addRowID(NSMutableDictionary *rowIDsByClass, Class class, sqlite3_int64 rowid)
+{
+    id rowIDs = rowIDsByClass[class];
+    if (! rowIDs) rowIDsByClass[(id) class] = rowIDs = [NSMutableSet set];
+    if (rowIDs == NSNull.null) return;
+    if (((NSMutableSet *) rowIDs).count < FCModelMaxRecordedRowIDsPerClass) [rowIDs addObject:@(rowid)];
+    else rowIDsByClass[(id) class] = NSNull.null;
+}
+
+@interface FCModelDatabase ()
+- (Class)modelClassForTableName:(const char *)tableName;
+- (void)enqueueHookChangeForClass:(Class)class operation:(int)operation rowID:(sqlite3_int64)rowid;
+@end
 
+static void _sqlite3_update_hook(void *context, int sqlite_operation, char const *db_name, char const *table_name, sqlite3_int64 rowid)
+{
     FCModelDatabase *queue = (__bridge FCModelDatabase *) context;
-    if (queue.isInInternalWrite) return;
+    Class class = [queue modelClassForTableName:table_name];
+    if (! class) return;
 
-    // Can't run synchronously since SQLite requires that no other database queries are executed before this function returns,
-    //  and queries are likely to be executed by any notification listeners.
-    if (queue.isQueuingNotifications) [class postChangeNotificationWithChangedFields:nil changedObject:nil changeType:FCModelChangeTypeUnspecified priorFieldValues:nil];
-    else dispatch_async(dispatch_get_main_queue(), ^{ [class postChangeNotificationWithChangedFields:nil changedObject:nil changeType:FCModelChangeTypeUnspecified priorFieldValues:nil]; });
+    if (queue.isInInternalWrite) {
+        if (class == queue.internalWriteClass && ! queue.lastInternalWriteOperation) queue.lastInternalWriteOperation = sqlite_operation;
+        return;
+    }
+    
+    if (queue.isRecordingAffectedRowIDs) fcm_addRowID(queue.affectedRowIDsByClass, class, rowid);
+
+    if (queue.isQueuingNotifications) [class enqueueUpdateHookOperation:sqlite_operation rowID:rowid];
+    else [queue enqueueHookChangeForClass:class operation:sqlite_operation rowID:rowid];
 }
 
+// Installing a WAL hook replaces SQLite's automatic checkpointing, so the hook checkpoints at the same default threshold
+static const int FCModelWALAutoCheckpointPages = 1000;
+
+@interface FCModelDatabase ()
+- (void)incrementWriteCount;
+@end
+
+// Called after each commit in WAL mode
+static int _sqlite3_wal_hook(void *context, sqlite3 *db, const char *db_name, int pageCount)
+{
+    [(__bridge FCModelDatabase *) context incrementWriteCount];
+    if (pageCount >= FCModelWALAutoCheckpointPages) sqlite3_wal_checkpoint(db, db_name);
+    return SQLITE_OK;
+}
+
+static void *FCModelDatabaseQueueKey = &FCModelDatabaseQueueKey;
+static NSString * const FCModelDatabaseReaderWriteCountKey = @"FCModelDatabaseReaderWriteCount";
+static NSString * const FCModelDatabaseReaderCheckInBlocksKey = @"FCModelDatabaseReaderCheckInBlocks";
+
 @interface FCModelDatabase ()
 @property (nonatomic) FMDatabase *openDatabase;
 @property (nonatomic) NSString *path;
+@property (nonatomic) dispatch_queue_t privateQueue;
+@property (nonatomic) NSUInteger maxConcurrentReaders;
+@property (nonatomic) FMDatabasePool *readerPool;
+@property (nonatomic) dispatch_semaphore_t availableReaders;
 @property (nonatomic) NSMutableDictionary *enqueuedChangedFieldsByClass;
+@property (nonatomic) NSMutableDictionary *enqueuedKeyChangesByClass;
+@property (nonatomic) NSMutableDictionary *affectedRowIDsByClass;
+@property (nonatomic) NSMutableDictionary *pendingHookRowIDsByClass;
+@property (nonatomic) NSMutableDictionary *pendingHookKeyChangesByClass;
+@property (nonatomic) BOOL hookNotificationsScheduled;
 @property (nonatomic) BOOL inExpectedWrite;
+@property NSUInteger writeCount;
+@property (copy) NSSet *cachedStatementSQL;
 @end
 
-@implementation FCModelDatabase
+@implementation FCModelDatabase {
+    CFMutableDictionaryRef _modelClassesByTableName; // const char * table name -> unretained Class
+    FMDatabase *_statementAnalysisDatabase;
+}
+
+- (instancetype)initWithDatabasePath:(NSString *)path { return [self initWithDatabasePath:path usingPrivateQueue:NO]; }
+
+- (instancetype)initWithDatabasePath:(NSString *)path usingPrivateQueue:(BOOL)usePrivateQueue { return [self initWithDatabasePath:path usingPrivateQueue:usePrivateQueue maxConcurrentReaders:0]; }
 
-- (instancetype)initWithDatabasePath:(NSString *)path
+- (instancetype)initWithDatabasePath:(NSString *)path usingPrivateQueue:(BOOL)usePrivateQueue maxConcurrentReaders:(NSUInteger)readerCount
 {
     if ( (self = [super init]) ) {
         self.path = path;
+        self.maxConcurrentReaders = readerCount;
+        if (readerCount) self.availableReaders = dispatch_semaphore_create((long) readerCount);
         self.enqueuedChangedFieldsByClass = [NSMutableDictionary dictionary];
+        self.enqueuedKeyChangesByClass = [NSMutableDictionary dictionary];
+        self.affectedRowIDsByClass = [NSMutableDictionary dictionary];
+        self.pendingHookRowIDsByClass = [NSMutableDictionary dictionary];
+        self.pendingHookKeyChangesByClass = [NSMutableDictionary dictionary];
+        if (usePrivateQueue) {
+            self.privateQueue = dispatch_queue_create("FCModelDatabase", DISPATCH_QUEUE_SERIAL);
+            dispatch_queue_set_specific(_privateQueue, FCModelDatabaseQueueKey, (__bridge void *) self, NULL);
+        }
     }
     return self;
 }
 
+- (BOOL)usesPrivateQueue { return _privateQueue != nil; }
+
+- (BOOL)isOnDatabaseQueue
+{
+    if (_privateQueue) return dispatch_get_specific(FCModelDatabaseQueueKey) == (__bridge void *) self;
+    return NSThread.isMainThread;
+}
+
+- (void)performSync:(void (^)(void))block
+{
+    if (! _privateQueue) fcm_onMainQueue(block);
+    else if (dispatch_get_specific(FCModelDatabaseQueueKey) == (__bridge void *) self) block();
+    else dispatch_sync(_privateQueue, block);
+}
+
+- (void)performAsync:(void (^)(void))block
+{
+    dispatch_async(_privateQueue ?: dispatch_get_main_queue(), block);
+}
+
+- (void)performAfterDelay:(NSTimeInterval)delay block:(void (^)(void))block
+{
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (delay * NSEC_PER_SEC)), _privateQueue ?: dispatch_get_main_queue(), block);
+}
+
 - (FMDatabase *)database
 {
-    if (! _openDatabase) fcm_onMainQueue(^{
+    if (! _openDatabase) [self performSync:^{
+        if (self.openDatabase) return;
         self.openDatabase = [[FMDatabase alloc] initWithPath:_path];
         if (! [_openDatabase open]) {
             [[NSException exceptionWithName:NSGenericException reason:[NSString stringWithFormat:@"Cannot open or create database at path: %@", self.path] userInfo:nil] raise];
         }
 
         sqlite3_update_hook(_openDatabase.sqliteHandle, &_sqlite3_update_hook, (__bridge void *) self);
-    });
+        _openDatabase.shouldCacheStatements = YES;
+
+        if (_maxConcurrentReaders) {
+            // Readers can only run concurrently with the writer in WAL mode
+            FMResultSet *rs = [_openDatabase executeQuery:@"PRAGMA journal_mode = WAL"];
+            NSString *journalMode = [rs next] ? [rs stringForColumnIndex:0] : nil;
+            [rs close];
+            if ([journalMode caseInsensitiveCompare:@"wal"] != NSOrderedSame) {
+                NSLog(@"[FCModel] Warning: Cannot enable WAL journal mode, so concurrent readers are disabled");
+                self.maxConcurrentReaders = 0;
+            } else {
+                sqlite3_wal_hook(_openDatabase.sqliteHandle, &_sqlite3_wal_hook, (__bridge void *) self);
+            }
+        }
+    }];
     return _openDatabase;
 }
 
+- (FMDatabasePool *)readerPool
+{
+    if (! _readerPool) {
+        // The writer must be open (and in WAL mode) before any readers are
+        __unused FMDatabase *writer = self.database;
+        @synchronized (self) {
+            if (! _readerPool && _maxConcurrentReaders) {
+                FMDatabasePool *pool = [[FMDatabasePool alloc] initWithPath:_path flags:SQLITE_OPEN_READONLY];
+                pool.maximumNumberOfDatabasesToCreate = _maxConcurrentReaders;
+                pool.delegate = self;
+                self.readerPool = pool;
+            }
+        }
+    }
+    return _readerPool;
+}
+
+- (void)databasePool:(FMDatabasePool *)pool didAddDatabase:(FMDatabase *)database
+{
+    database.shouldCacheStatements = YES;
+}
+
+- (void)inReadOnlyDatabase:(void (^)(FMDatabase *db))block
+{
+    // Saves in an open group commit aren't visible to readers yet, so read them from the writer until it's flushed
+    FMDatabasePool *pool;
+    if (
+        ! _maxConcurrentReaders || _isInGroupCommit || [self isOnDatabaseQueue] || ! (pool = self.readerPool) ||
+        0 != dispatch_semaphore_wait(_availableReaders, DISPATCH_TIME_NOW)
+    ) {
+        [self performSync:^{ [self inDatabase:block]; }];
+        return;
+    }
+
+    __block BOOL ranOnReader = NO;
+    __block NSArray *checkInBlocks = nil;
+    [pool inDatabase:^(FMDatabase *db) {
+        if (! db) return;
+        ranOnReader = YES;
+
+        // Recorded before the reader's snapshot can begin, so any write that isn't in the snapshot changes writeCount
+        NSMutableDictionary *threadDictionary = NSThread.currentThread.threadDictionary;
+        id outerWriteCount = threadDictionary[FCModelDatabaseReaderWriteCountKey];
+        id outerCheckInBlocks = threadDictionary[FCModelDatabaseReaderCheckInBlocksKey];
+        threadDictionary[FCModelDatabaseReaderWriteCountKey] = @(self.writeCount);
+        threadDictionary[FCModelDatabaseReaderCheckInBlocksKey] = [NSMutableArray array];
+        block(db);
+        checkInBlocks = threadDictionary[FCModelDatabaseReaderCheckInBlocksKey];
+        if (outerWriteCount) threadDictionary[FCModelDatabaseReaderWriteCountKey] = outerWriteCount;
+        else [threadDictionary removeObjectForKey:FCModelDatabaseReaderWriteCountKey];
+        if (outerCheckInBlocks) threadDictionary[FCModelDatabaseReaderCheckInBlocksKey] = outerCheckInBlocks;
+        else [threadDictionary removeObjectForKey:FCModelDatabaseReaderCheckInBlocksKey];
+        [self discardUncachedStatementsInDatabase:db];
+    }];
+    dispatch_semaphore_signal(_availableReaders);
+
+    for (void (^checkInBlock)(void) in checkInBlocks) checkInBlock();
+    if (! ranOnReader) [self performSync:^{ [self inDatabase:block]; }];
+}
+
+- (BOOL)performAfterReaderCheckIn:(void (^)(void))block
+{
+    if ([self isOnDatabaseQueue]) return NO;
+    NSMutableArray *checkInBlocks = NSThread.currentThread.threadDictionary[FCModelDatabaseReaderCheckInBlocksKey];
+    [checkInBlocks addObject:[block copy]];
+    return checkInBlocks != nil;
+}
+
+// Only called on the writer, so the atomic property is enough for readers on other threads
+- (void)incrementWriteCount { self.writeCount++; }
+
+- (NSUInteger)readerWriteCount
+{
+    if ([self isOnDatabaseQueue]) return self.writeCount;
+    NSNumber *readerWriteCount = NSThread.currentThread.threadDictionary[FCModelDatabaseReaderWriteCountKey];
+    return readerWriteCount ? readerWriteCount.unsignedIntegerValue : self.writeCount;
+}
+
+- (void)inStatementAnalysisDatabase:(void (^)(sqlite3 *db))block
+{
+    // The writer must be open (creating the file) before it can be opened read-only
+    __unused FMDatabase *writer = self.database;
+    @synchronized (self) {
+        if (! _statementAnalysisDatabase && _path.length) {
+            FMDatabase *db = [[FMDatabase alloc] initWithPath:_path];
+            if ([db openWithFlags:SQLITE_OPEN_READONLY]) {
+                // For the custom functions, collations, or encryption keys that statements may need to prepare
+                if (_databaseInitializer) _databaseInitializer(db);
+                _statementAnalysisDatabase = db;
+            }
+        }
+        if (_statementAnalysisDatabase) block(_statementAnalysisDatabase.sqliteHandle);
+    }
+}
+
+- (void)addCachedStatementSQL:(NSString *)sql
+{
+    @synchronized (self) {
+        NSSet *cachedStatementSQL = self.cachedStatementSQL;
+        if (! [cachedStatementSQL containsObject:sql]) self.cachedStatementSQL = cachedStatementSQL ? [cachedStatementSQL setByAddingObject:sql] : [NSSet setWithObject:sql];
+    }
+}
+
+// Only scans once the connection has cached more statements than there are fixed ones, so each connection keeps at most
+//  that many. Statements still in use by open result sets are released by them when they close.
+- (void)discardUncachedStatementsInDatabase:(FMDatabase *)db
+{
+    NSSet *cachedStatementSQL = self.cachedStatementSQL;
+    NSMutableDictionary *statements = db.cachedStatements;
+    if (statements.count <= cachedStatementSQL.count) return;
+    for (NSString *sql in statements.allKeys) {
+        if (! [cachedStatementSQL containsObject:sql]) [statements removeObjectForKey:sql];
+    }
+}
+
+- (void)closeStatementAnalysisDatabase
+{
+    @synchronized (self) {
+        [_statementAnalysisDatabase close];
+        _statementAnalysisDatabase = nil;
+    }
+}
+
+#pragma mark - Update hook
+
+- (void)setModelClassesByTableName:(NSDictionary *)classesByTableName
+{
+    [self performSync:^{
+        CFMutableDictionaryRef modelClassesByTableName = CFDictionaryCreateMutable(NULL, (CFIndex) classesByTableName.count, &FCModelTableNameKeyCallBacks, NULL);
+        [classesByTableName enumerateKeysAndObjectsUsingBlock:^(NSString *tableName, Class modelClass, BOOL *stop) {
+            CFDictionarySetValue(modelClassesByTableName, tableName.UTF8String, (__bridge const void *) modelClass);
+        }];
+        if (_modelClassesByTableName) CFRelease(_modelClassesByTableName);
+        _modelClassesByTableName = modelClassesByTableName;
+    }];
+}
+
+- (Class)modelClassForTableName:(const char *)tableName
+{
+    return _modelClassesByTableName ? (__bridge Class) CFDictionaryGetValue(_modelClassesByTableName, tableName) : nil;
+}
+
+// Outside of queued notifications, hook events are collected until the database queue's next turn, then posted as one
+//  notification per class with the affected rowids (and primary keys, if known)
+- (void)enqueueHookChangeForClass:(Class)class operation:(int)operation rowID:(sqlite3_int64)rowid
+{
+    fcm_addRowID(_pendingHookRowIDsByClass, class, rowid);
+    [class recordUpdateHookOperation:operation rowID:rowid inKeyChangesByClass:_pendingHookKeyChangesByClass];
+    if (_hookNotificationsScheduled) return;
+    _hookNotificationsScheduled = YES;
+    
+    // Can't run synchronously since SQLite requires that no other database queries are executed before this function returns,
+    //  and queries are likely to be executed by any notification listeners.
+    [self performAsync:^{
+        NSDictionary *rowIDsByClass = [self.pendingHookRowIDsByClass copy];
+        NSDictionary *keyChangesByClass = [self.pendingHookKeyChangesByClass copy];
+        [self.pendingHookRowIDsByClass removeAllObjects];
+        [self.pendingHookKeyChangesByClass removeAllObjects];
+        self.hookNotificationsScheduled = NO;
+        
+        [rowIDsByClass enumerateKeysAndObjectsUsingBlock:^(Class class, id rowIDs, BOOL *stop) {
+            [class
+                postChangeNotificationWithChangedFields:nil changedObject:nil changeType:FCModelChangeTypeUnspecified priorFieldValues:nil
+                keyChanges:keyChangesByClass[class] additionalUserInfo:(rowIDs == NSNull.null ? nil : @{ FCModelChangedRowIDsKey : [rowIDs copy] })
+            ];
+        }];
+    }];
+}
+
 - (void)close
 {
+    _readerPool.delegate = nil;
+    [self.readerPool releaseAllDatabases];
+    self.readerPool = nil;
+    [self closeStatementAnalysisDatabase];
     [self.openDatabase close];
     self.openDatabase = nil;
 }
 
 - (void)dealloc
 {
+    if (_modelClassesByTableName) CFRelease(_modelClassesByTableName);
+    _readerPool.delegate = nil;
+    [_readerPool releaseAllDatabases];
+    [_statementAnalysisDatabase close];
     [_openDatabase close];
     self.openDatabase = nil;
 }
 
 - (void)inDatabase:(void (^)(FMDatabase *db))block
 {
-    dispatch_assert_queue(dispatch_get_main_queue());
-    block(self.database);
+    dispatch_assert_queue(_privateQueue ?: dispatch_get_main_queue());
+    FMDatabase *db = self.database;
+    block(db);
+    [self discardUncachedStatementsInDatabase:db];
 }
 
 @end
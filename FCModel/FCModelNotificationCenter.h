@@ -11,6 +11,11 @@
 
 + (instancetype)defaultCenter;
 - (void)addObserver:(id)target selector:(SEL)action class:(Class)class changedFields:(NSSet *)changedFields;
+- (void)addObserver:(id)target selector:(SEL)action class:(Class)class primaryKey:(id)primaryKey changedFields:(NSSet *)changedFields;
 - (void)removeFieldChangeObservers:(id)target;
+- (void)removeFieldChangeObservers:(id)target class:(Class)class primaryKey:(id)primaryKey;
+
+// Moves the observers of an instance to its new primary key, e.g. when a generated key is replaced at insert time
+- (void)replacePrimaryKey:(id)oldPrimaryKey withPrimaryKey:(id)newPrimaryKey forClass:(Class)class;
 
 @end
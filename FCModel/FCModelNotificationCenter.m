@@ -8,8 +8,40 @@
 #import "FCModelNotificationCenter.h"
 #import "FCModel.h"
 
+// defined in FCModel.m
+extern NSSet *fcm_primaryKeysChangedByNotification(NSNotification *n);
+
+@interface FCModelFieldChangeObserver : NSObject
+@property (nonatomic, weak) id target;
+@property (nonatomic) SEL action;
+@property (nonatomic, copy) NSSet *fieldNames; // nil for all fields
+@property (nonatomic) id primaryKey; // nil for all instances
+@property (nonatomic) NSUInteger order;
+@property (nonatomic) NSUInteger lastDispatch;
+@end
+
+@implementation FCModelFieldChangeObserver
+@end
+
+// All field-change observers of one class, behind a single NSNotificationCenter observer. Each class-wide observer is
+//  listed under every field it watches, so a change only visits the observers of the fields that changed. Instance
+//  observers are listed under their primary key, and only visited when that row changed.
+@interface FCModelClassObservers : NSObject
+@property (nonatomic) id notificationObserver;
+@property (nonatomic) NSMutableDictionary *observersByFieldName;
+@property (nonatomic) NSMutableArray *allFieldsObservers;
+@property (nonatomic) NSMutableDictionary *observersByPrimaryKey;
+@property (nonatomic) NSUInteger count;
+@end
+
+@implementation FCModelClassObservers
+@end
+
 @interface FCModelNotificationCenter ()
 @property (nonatomic) NSMapTable *observersByTarget;
+@property (nonatomic) NSMutableDictionary *observersByClass;
+@property (nonatomic) NSUInteger observerCount;
+@property (nonatomic) NSUInteger dispatchCount;
 @property (nonatomic) dispatch_queue_t targetWriteQueue;
 @end
 
@@ -27,32 +59,128 @@
 {
     if ( (self = [super init]) ) {
         self.observersByTarget = [NSMapTable weakToStrongObjectsMapTable];
+        self.observersByClass = [NSMutableDictionary dictionary];
         self.targetWriteQueue = dispatch_queue_create("FCModelNotificationCenter", DISPATCH_QUEUE_SERIAL);
     }
     return self;
 }
 
 - (void)addObserver:(id)target selector:(SEL)action class:(Class)class changedFields:(NSSet *)requestedFields
+{
+    [self addObserver:target selector:action class:class primaryKey:nil changedFields:requestedFields];
+}
+
+- (void)addObserver:(id)target selector:(SEL)action class:(Class)class primaryKey:(id)primaryKey changedFields:(NSSet *)requestedFields
 {
     dispatch_sync(_targetWriteQueue, ^{
+        FCModelFieldChangeObserver *observer = [FCModelFieldChangeObserver new];
+        observer.target = target;
+        observer.action = action;
+        observer.fieldNames = requestedFields;
+        observer.primaryKey = primaryKey;
+        observer.order = _observerCount++;
+
         NSMutableArray *targetObservers = [_observersByTarget objectForKey:target];
         if (! targetObservers) [_observersByTarget setObject:(targetObservers = [NSMutableArray array]) forKey:target];
-        
-        __weak id weakTarget = target;
-        [targetObservers addObject:[NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:class queue:NSOperationQueue.mainQueue usingBlock:^(NSNotification *n) {
-            __strong id strongTarget = weakTarget;
-            if (! strongTarget) return;
-            NSSet *changedFields = n.userInfo[FCModelChangedFieldsKey];
-            if (! changedFields || ! requestedFields || [changedFields intersectsSet:requestedFields]) {
+        [targetObservers addObject:@[ class, observer ]];
+
+        FCModelClassObservers *classObservers = _observersByClass[class];
+        if (! classObservers) {
+            classObservers = [FCModelClassObservers new];
+            classObservers.observersByFieldName = [NSMutableDictionary dictionary];
+            classObservers.allFieldsObservers = [NSMutableArray array];
+            classObservers.observersByPrimaryKey = [NSMutableDictionary dictionary];
+            __weak typeof(self) weakSelf = self;
+            classObservers.notificationObserver = [NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:class queue:NSOperationQueue.mainQueue usingBlock:^(NSNotification *n) {
+                [weakSelf dispatchNotification:n forClass:class];
+            }];
+            _observersByClass[(id) class] = classObservers;
+        }
+
+        classObservers.count++;
+        if (primaryKey) {
+            NSMutableArray *instanceObservers = classObservers.observersByPrimaryKey[primaryKey];
+            if (! instanceObservers) classObservers.observersByPrimaryKey[primaryKey] = (instanceObservers = [NSMutableArray array]);
+            [instanceObservers addObject:observer];
+        } else if (! requestedFields) {
+            [classObservers.allFieldsObservers addObject:observer];
+        } else {
+            for (NSString *fieldName in requestedFields) {
+                NSMutableArray *fieldObservers = classObservers.observersByFieldName[fieldName];
+                if (! fieldObservers) classObservers.observersByFieldName[fieldName] = (fieldObservers = [NSMutableArray array]);
+                [fieldObservers addObject:observer];
+            }
+        }
+    });
+}
+
+- (void)dispatchNotification:(NSNotification *)n forClass:(Class)class
+{
+    NSSet *changedFields = n.userInfo[FCModelChangedFieldsKey];
+    NSMutableArray *matchingObservers = [NSMutableArray array];
+
+    dispatch_sync(_targetWriteQueue, ^{
+        FCModelClassObservers *classObservers = _observersByClass[class];
+        if (! classObservers) return;
+
+        // An observer watching several of the changed fields is only collected once per dispatch. Observers whose targets
+        //  have been deallocated are removed once the lists have been walked.
+        NSUInteger dispatch = ++_dispatchCount;
+        NSMutableArray *deadObservers = [NSMutableArray array];
+        void (^collect)(NSArray *) = ^(NSArray *observers) {
+            for (FCModelFieldChangeObserver *observer in observers) {
+                if (observer.lastDispatch == dispatch) continue;
+                observer.lastDispatch = dispatch;
+                [(observer.target ? matchingObservers : deadObservers) addObject:observer];
+            }
+        };
+
+        collect(classObservers.allFieldsObservers);
+        if (changedFields) {
+            for (NSString *fieldName in changedFields) collect(classObservers.observersByFieldName[fieldName]);
+        } else {
+            for (NSArray *fieldObservers in classObservers.observersByFieldName.objectEnumerator) collect(fieldObservers);
+        }
+
+        if (classObservers.observersByPrimaryKey.count) {
+            void (^collectInstanceObservers)(NSArray *) = ^(NSArray *observers) {
+                for (FCModelFieldChangeObserver *observer in observers) {
+                    if (! observer.target) [deadObservers addObject:observer];
+                    else if (! changedFields || ! observer.fieldNames || [observer.fieldNames intersectsSet:changedFields]) [matchingObservers addObject:observer];
+                }
+            };
+
+            NSSet *changedKeys = fcm_primaryKeysChangedByNotification(n);
+            if (! changedKeys) {
+                // Unknown rows changed, so any observed instance may have
+                for (NSArray *instanceObservers in classObservers.observersByPrimaryKey.objectEnumerator) collectInstanceObservers(instanceObservers);
+            } else if (changedKeys.count < classObservers.observersByPrimaryKey.count) {
+                for (id key in changedKeys) collectInstanceObservers(classObservers.observersByPrimaryKey[key]);
+            } else {
+                [classObservers.observersByPrimaryKey enumerateKeysAndObjectsUsingBlock:^(id key, NSArray *instanceObservers, BOOL *stop) {
+                    if ([changedKeys containsObject:key]) collectInstanceObservers(instanceObservers);
+                }];
+            }
+        }
+
+        for (FCModelFieldChangeObserver *observer in deadObservers) [self removeObserver:observer forClass:class];
+    });
+
+    // Deliver in the order the observers were added, as when each had its own NSNotificationCenter observer
+    [matchingObservers sortUsingComparator:^NSComparisonResult(FCModelFieldChangeObserver *a, FCModelFieldChangeObserver *b) {
+        return a.order < b.order ? NSOrderedAscending : (a.order > b.order ? NSOrderedDescending : NSOrderedSame);
+    }];
+
+    for (FCModelFieldChangeObserver *observer in matchingObservers) {
+        __strong id strongTarget = observer.target;
+        if (! strongTarget) continue;
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Warc-performSelector-leaks"
-                [strongTarget performSelector:action withObject:n];
+        [strongTarget performSelector:observer.action withObject:n];
 #pragma clang diagnostic pop
 
-            }
-        }]];
-    });
+    }
 }
 
 - (void)removeFieldChangeObservers:(id)target
@@ -60,9 +188,64 @@
     dispatch_sync(_targetWriteQueue, ^{
         NSMutableArray *targetObservers = [_observersByTarget objectForKey:target];
         if (! targetObservers) return;
-        for (id observer in targetObservers) [NSNotificationCenter.defaultCenter removeObserver:observer];
+        for (NSArray *classAndObserver in targetObservers) [self removeObserver:classAndObserver[1] forClass:classAndObserver[0]];
         [_observersByTarget removeObjectForKey:target];
     });
 }
 
+- (void)removeFieldChangeObservers:(id)target class:(Class)class primaryKey:(id)primaryKey
+{
+    dispatch_sync(_targetWriteQueue, ^{
+        NSMutableArray *targetObservers = [_observersByTarget objectForKey:target];
+        NSIndexSet *matchingIndexes = [targetObservers indexesOfObjectsPassingTest:^BOOL(NSArray *classAndObserver, NSUInteger idx, BOOL *stop) {
+            return classAndObserver[0] == class && [((FCModelFieldChangeObserver *) classAndObserver[1]).primaryKey isEqual:primaryKey];
+        }];
+        if (! matchingIndexes.count) return;
+
+        for (NSArray *classAndObserver in [targetObservers objectsAtIndexes:matchingIndexes]) [self removeObserver:classAndObserver[1] forClass:class];
+        [targetObservers removeObjectsAtIndexes:matchingIndexes];
+        if (! targetObservers.count) [_observersByTarget removeObjectForKey:target];
+    });
+}
+
+- (void)replacePrimaryKey:(id)oldPrimaryKey withPrimaryKey:(id)newPrimaryKey forClass:(Class)class
+{
+    dispatch_sync(_targetWriteQueue, ^{
+        FCModelClassObservers *classObservers = _observersByClass[class];
+        NSMutableArray *instanceObservers = classObservers.observersByPrimaryKey[oldPrimaryKey];
+        if (! instanceObservers) return;
+
+        for (FCModelFieldChangeObserver *observer in instanceObservers) observer.primaryKey = newPrimaryKey;
+        [classObservers.observersByPrimaryKey removeObjectForKey:oldPrimaryKey];
+        NSMutableArray *existingObservers = classObservers.observersByPrimaryKey[newPrimaryKey];
+        if (existingObservers) [existingObservers addObjectsFromArray:instanceObservers];
+        else classObservers.observersByPrimaryKey[newPrimaryKey] = instanceObservers;
+    });
+}
+
+- (void)removeObserver:(FCModelFieldChangeObserver *)observer forClass:(Class)class
+{
+    FCModelClassObservers *classObservers = _observersByClass[class];
+    if (! classObservers) return;
+
+    if (observer.primaryKey) {
+        NSMutableArray *instanceObservers = classObservers.observersByPrimaryKey[observer.primaryKey];
+        [instanceObservers removeObjectIdenticalTo:observer];
+        if (instanceObservers && ! instanceObservers.count) [classObservers.observersByPrimaryKey removeObjectForKey:observer.primaryKey];
+    } else if (! observer.fieldNames) {
+        [classObservers.allFieldsObservers removeObjectIdenticalTo:observer];
+    } else {
+        for (NSString *fieldName in observer.fieldNames) {
+            NSMutableArray *fieldObservers = classObservers.observersByFieldName[fieldName];
+            [fieldObservers removeObjectIdenticalTo:observer];
+            if (fieldObservers && ! fieldObservers.count) [classObservers.observersByFieldName removeObjectForKey:fieldName];
+        }
+    }
+
+    if (--classObservers.count == 0) {
+        [NSNotificationCenter.defaultCenter removeObserver:classObservers.notificationObserver];
+        [_observersByClass removeObjectForKey:class];
+    }
+}
+
 @end
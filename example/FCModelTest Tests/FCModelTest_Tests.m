@@ -8,11 +8,15 @@
 
 #import <XCTest/XCTest.h>
 #import "FCModel.h"
+#import "FCModelCachedObject.h"
 #import "SimpleModel.h"
 #import "SimplerModel.h"
+#import "InitOverrideModel.h"
+#import "SequentialKeyModel.h"
 
 @interface FCModelTest_Tests : XCTestCase
-
+@property (nonatomic) int nameChangeCount;
+@property (nonatomic) int dateChangeCount;
 @end
 
 @implementation FCModelTest_Tests
@@ -363,10 +367,764 @@
     [NSNotificationCenter.defaultCenter removeObserver:observer];
 }
 
+- (void)testPrivateDatabaseQueue
+{
+    [FCModel closeDatabase];
+    [self openDatabaseWithOptions:FCModelDatabaseOptionPrivateQueue];
+
+    __block BOOL notifiedOnMainThread = NO;
+    id observer = [NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:SimplerModel.class queue:nil usingBlock:^(NSNotification *n) {
+        notifiedOnMainThread = NSThread.isMainThread;
+    }];
+
+    XCTestExpectation *saved = [self expectationWithDescription:@"background save"];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+        SimplerModel *model = [SimplerModel instanceWithPrimaryKey:@1];
+        [model save:^{ model.title = @"background"; }];
+        [saved fulfill];
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    // Notifications are delivered asynchronously on main, so let the run loop deliver them
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertTrue(notifiedOnMainThread);
+    XCTAssertEqualObjects([SimplerModel instanceWithPrimaryKey:@1 createIfNonexistent:NO].title, @"background");
+
+    [NSNotificationCenter.defaultCenter removeObserver:observer];
+}
+
+- (void)testConcurrentReaders
+{
+    [FCModel closeDatabase];
+    [self openDatabaseWithOptions:FCModelDatabaseOptionConcurrentReaders];
+
+    [FCModel performTransaction:^BOOL{
+        for (int i = 1; i <= 100; i++) {
+            SimplerModel *model = [SimplerModel instanceWithPrimaryKey:@(i)];
+            [model save:^{ model.title = @"reader"; }];
+        }
+        return YES;
+    }];
+
+    __block int mismatches = 0;
+    dispatch_apply(16, dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^(size_t i) {
+        NSArray *instances = [SimplerModel instancesWhere:@"title = ?", @"reader"];
+        BOOL mismatch = instances.count != 100 || [SimplerModel numberOfInstances] != 100;
+        mismatch = mismatch || [SimplerModel instanceWithPrimaryKey:@1 createIfNonexistent:NO] != instances.firstObject;
+        if (mismatch) @synchronized (self) { mismatches++; }
+    });
+    XCTAssertEqual(mismatches, 0);
+}
+
+- (void)testConcurrentReaderDoesNotRegisterInstancesOlderThanWrites
+{
+    [FCModel closeDatabase];
+    [self openDatabaseWithOptions:FCModelDatabaseOptionPrivateQueue | FCModelDatabaseOptionConcurrentReaders];
+    for (int i = 1; i <= 3; i++) [SimplerModel executeUpdateQuery:@"INSERT INTO $T (id, title) VALUES (?, 'before')", @(i)];
+
+    // The write commits while the reader is still stepping through its older snapshot
+    NSMutableArray *instances = [NSMutableArray array];
+    [SimplerModel enumerateInstancesWhere:@"1 ORDER BY id" arguments:nil usingBlock:^(SimplerModel *instance, BOOL *stop) {
+        if (! instances.count) {
+            [SimplerModel executeUpdateQuery:@"UPDATE $T SET title = 'after' WHERE id = 2"];
+            [SimplerModel executeUpdateQuery:@"DELETE FROM $T WHERE id = 3"];
+        }
+        [instances addObject:instance];
+    }];
+
+    XCTAssertEqual(instances.count, 2);
+    XCTAssertEqualObjects(((SimplerModel *) instances.lastObject).title, @"after");
+    XCTAssertEqual([SimplerModel instanceWithPrimaryKey:@2 createIfNonexistent:NO], instances.lastObject);
+    XCTAssertNil([SimplerModel instanceWithPrimaryKey:@3 createIfNonexistent:NO]);
+}
+
+- (void)testConcurrentReaderQueryFailureIsReportedAfterCheckIn
+{
+    [FCModel closeDatabase];
+    [self openDatabaseWithOptions:FCModelDatabaseOptionPrivateQueue | FCModelDatabaseOptionConcurrentReaders];
+
+    XCTAssertThrows([SimplerModel instancesWhere:@"nonexistentColumn = 1"]);
+    XCTAssertFalse([FCModel databaseIsOpen]);
+
+    [self openDatabaseWithOptions:FCModelDatabaseOptionPrivateQueue | FCModelDatabaseOptionConcurrentReaders];
+    XCTAssertEqual([SimplerModel numberOfInstances], 0);
+}
+
+- (void)testAsyncQueriesAndSave
+{
+    SimplerModel *model = [SimplerModel instanceWithPrimaryKey:@1];
+    XCTestExpectation *saved = [self expectationWithDescription:@"async save"];
+    [model saveAsync:^{ model.title = @"async"; } completion:^(BOOL success) {
+        XCTAssertTrue(NSThread.isMainThread);
+        XCTAssertTrue(success);
+        [saved fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTestExpectation *fetched = [self expectationWithDescription:@"async fetch"];
+    dispatch_queue_t completionQueue = dispatch_queue_create("test", NULL);
+    [SimplerModel instancesWhere:@"title = ?" arguments:@[ @"async" ] completionQueue:completionQueue completion:^(NSArray *instances) {
+        XCTAssertEqual(instances.count, 1);
+        XCTAssertEqual(instances.firstObject, model);
+        [fetched fulfill];
+    }];
+
+    XCTestExpectation *counted = [self expectationWithDescription:@"async count"];
+    [SimplerModel numberOfInstancesWhere:nil arguments:nil completion:^(NSUInteger count) {
+        XCTAssertEqual(count, 1);
+        [counted fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testGroupCommit
+{
+    __block int notifications = 0;
+    id observer = [NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:SimplerModel.class queue:nil usingBlock:^(NSNotification *n) {
+        notifications++;
+    }];
+
+    [FCModel setGroupCommitWindow:60 maxSaveCount:0];
+    for (int i = 1; i <= 10; i++) {
+        SimplerModel *model = [SimplerModel instanceWithPrimaryKey:@(i)];
+        [model save:^{ model.title = @"grouped"; }];
+    }
+    XCTAssertEqual(notifications, 0);
+    XCTAssertEqual([SimplerModel numberOfInstancesWhere:@"title = 'grouped'"], 10);
+
+    [FCModel flushGroupCommit];
+    XCTAssertEqual(notifications, 1);
+    XCTAssertFalse(FCModel.isInTransaction);
+
+    [FCModel setGroupCommitWindow:60 maxSaveCount:2];
+    [[SimplerModel instanceWithPrimaryKey:@1] save:^{ [SimplerModel instanceWithPrimaryKey:@1].title = @"a"; }];
+    [[SimplerModel instanceWithPrimaryKey:@2] save:^{ [SimplerModel instanceWithPrimaryKey:@2].title = @"b"; }];
+    XCTAssertEqual(notifications, 2);
+
+    // isInTransaction neither counts nor flushes an open group, and delete commits it first
+    [FCModel setGroupCommitWindow:60 maxSaveCount:0];
+    [[SimplerModel instanceWithPrimaryKey:@3] save:^{ [SimplerModel instanceWithPrimaryKey:@3].title = @"c"; }];
+    XCTAssertFalse(FCModel.isInTransaction);
+    XCTAssertEqual(notifications, 2);
+    [[SimplerModel instanceWithPrimaryKey:@4] delete];
+    XCTAssertEqual(notifications, 4);
+
+    [FCModel setGroupCommitWindow:0 maxSaveCount:0];
+    [NSNotificationCenter.defaultCenter removeObserver:observer];
+}
+
+- (void)testRowHydration
+{
+    @autoreleasepool {
+        SimpleModel *entity = [SimpleModel instanceWithPrimaryKey:@"a"];
+        [entity save:^{
+            entity.name = @"Alice";
+            entity.mixedcase = 42;
+            entity.nullableNumberDefaultNull = @7;
+        }];
+    }
+    [FCModel closeDatabase];
+    [self openDatabase];
+
+    NSArray *instances = [SimpleModel allInstances];
+    XCTAssertEqual(instances.count, 1);
+    SimpleModel *entity = instances.firstObject;
+    XCTAssertEqualObjects(entity.name, @"Alice");
+    XCTAssertEqual(entity.mixedcase, 42);
+    XCTAssertEqualObjects(entity.nullableNumberDefaultNull, @7);
+    XCTAssertNil(entity.nullableNumberDefaultUnspecified);
+    XCTAssertEqualObjects(entity.nullableNumberDefault1, @1);
+    XCTAssertFalse(entity.hasUnsavedChanges);
+    XCTAssertEqual([SimpleModel instanceWithPrimaryKey:@"a"], entity);
+}
+
+- (void)testRowHydrationCallsOverriddenInitializer
+{
+    @autoreleasepool {
+        InitOverrideModel *entity = [InitOverrideModel instanceWithPrimaryKey:@1];
+        [entity save:^{ entity.title = @"loaded"; }];
+    }
+    [FCModel closeDatabase];
+    [self openDatabase];
+
+    InitOverrideModel *entity = [InitOverrideModel allInstances].firstObject;
+    XCTAssertEqualObjects(entity.title, @"loaded");
+    XCTAssertEqualObjects(entity.initialFieldValues[@"title"], @"loaded");
+    XCTAssertFalse(entity.hasUnsavedChanges);
+}
+
+- (void)testRowHydrationPerformance
+{
+    NSMutableArray *fieldValueDictionaries = [NSMutableArray array];
+    for (int i = 1; i <= 5000; i++) [fieldValueDictionaries addObject:@{ @"id" : @(i), @"title" : [NSString stringWithFormat:@"row %d", i] }];
+    @autoreleasepool { XCTAssertNotNil([SimplerModel insertInstancesWithFieldValues:fieldValueDictionaries]); }
+
+    [self measureBlock:^{
+        @autoreleasepool { XCTAssertEqual([SimplerModel allInstances].count, 5000); }
+    }];
+}
+
+- (void)testSetterChangeTracking
+{
+    SimpleModel *entity = [SimpleModel instanceWithPrimaryKey:@"a"];
+    [entity save:^{ entity.name = @"Alice"; entity.mixedcase = 1; }];
+    XCTAssertFalse(entity.hasUnsavedChanges);
+
+    entity.name = @"Alice";
+    XCTAssertFalse(entity.hasUnsavedChanges);
+
+    entity.mixedcase = 2;
+    XCTAssertEqualObjects(entity.changedFieldNames, @[ @"mixedcase" ]);
+    XCTAssertEqualObjects(entity.unsavedChanges[@"mixedcase"], @2);
+
+    [entity revertUnsavedChanges];
+    XCTAssertEqual(entity.mixedcase, 1);
+    XCTAssertFalse(entity.hasUnsavedChanges);
+
+    [entity setValue:@"Bob" forKey:@"name"];
+    XCTAssertEqualObjects(entity.changedFieldNames, @[ @"name" ]);
+    [entity save:nil];
+    XCTAssertFalse(entity.hasUnsavedChanges);
+    XCTAssertEqualObjects([SimpleModel firstValueFromQuery:@"SELECT name FROM $T WHERE uniqueID = 'a'"], @"Bob");
+
+    // Classes that don't opt in compare every field, so direct instance-variable writes aren't missed
+    SimplerModel *untracked = [SimplerModel instanceWithPrimaryKey:@1];
+    [untracked save:^{ untracked.title = @"setter"; }];
+    [untracked setValue:@"ivar" forKey:@"_title"];
+    XCTAssertEqualObjects(untracked.changedFieldNames, @[ @"title" ]);
+    [untracked save:nil];
+    XCTAssertEqualObjects([SimplerModel firstValueFromQuery:@"SELECT title FROM $T WHERE id = 1"], @"ivar");
+}
+
+- (void)testRowSnapshotOfUntrackedClass
+{
+    @autoreleasepool {
+        XCTAssertNotNil([SimplerModel insertInstancesWithFieldValues:@[ @{ @"id" : @1, @"title" : @"saved" }, @{ @"id" : @2 } ]]);
+    }
+
+    NSArray *instances = [SimplerModel instancesWhere:@"1 ORDER BY id"];
+    SimplerModel *titled = instances[0], *untitled = instances[1];
+    XCTAssertFalse(titled.hasUnsavedChanges);
+    XCTAssertFalse(untitled.hasUnsavedChanges);
+
+    titled.title = @"changed";
+    untitled.title = @"changed";
+    XCTAssertEqualObjects(titled.changedFieldNames, @[ @"title" ]);
+    XCTAssertEqualObjects(untitled.changedFieldNames, @[ @"title" ]);
+    [titled revertUnsavedChanges];
+    [untitled revertUnsavedChanges];
+    XCTAssertEqualObjects(titled.title, @"saved");
+    XCTAssertNil(untitled.title);
+
+    [titled save:^{ titled.title = @"resaved"; }];
+    XCTAssertFalse(titled.hasUnsavedChanges);
+    titled.title = @"changed";
+    [titled revertUnsavedChanges];
+    XCTAssertEqualObjects(titled.title, @"resaved");
+}
+
+- (void)testOldFieldValuesInUpdateNotification
+{
+    SimpleModel *entity = [SimpleModel instanceWithPrimaryKey:@"a"];
+    [entity save:^{ entity.name = @"Alice"; entity.mixedcase = 1; }];
+
+    __block NSDictionary *oldValues = nil;
+    id observer = [NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:SimpleModel.class queue:nil usingBlock:^(NSNotification *n) {
+        oldValues = n.userInfo[FCModelOldFieldValuesKey];
+    }];
+
+    [entity save:^{ entity.name = @"Bob"; entity.name = @"Carol"; }];
+    XCTAssertEqualObjects(oldValues[@"name"], @"Alice");
+    XCTAssertEqualObjects(oldValues[@"mixedcase"], @1);
+
+    entity.name = @"Dave";
+    [entity revertUnsavedChangeToFieldName:@"name"];
+    XCTAssertEqualObjects(entity.name, @"Carol");
+    XCTAssertFalse(entity.hasUnsavedChanges);
+
+    [NSNotificationCenter.defaultCenter removeObserver:observer];
+}
+
+- (void)testStreamingEnumeration
+{
+    [FCModel performTransaction:^BOOL{
+        for (int i = 1; i <= 1000; i++) [SimplerModel executeUpdateQuery:@"INSERT INTO $T (id, title) VALUES (?, ?)", @(i), @"row"];
+        return YES;
+    }];
+
+    __block NSUInteger count = 0;
+    [SimplerModel enumerateInstancesWhere:@"title = ?" arguments:@[ @"row" ] usingBlock:^(SimplerModel *instance, BOOL *stop) {
+        count++;
+        if (count == 300) *stop = YES;
+    }];
+    XCTAssertEqual(count, 300);
+
+    SimplerModel *loaded = [SimplerModel instanceWithPrimaryKey:@5];
+    __block NSUInteger unregisteredCount = 0;
+    __block BOOL sawLoadedInstance = NO;
+    [SimplerModel enumerateInstancesWhere:@"id <= 10" arguments:nil options:FCModelEnumerationOptionDoNotRegisterInstances usingBlock:^(SimplerModel *instance, BOOL *stop) {
+        unregisteredCount++;
+        if (instance == loaded) sawLoadedInstance = YES;
+    }];
+    XCTAssertEqual(unregisteredCount, 10);
+    XCTAssertTrue(sawLoadedInstance);
+
+    __block NSUInteger rowCount = 0;
+    [SimplerModel enumerateResultDictionariesFromQuery:@"SELECT id FROM $T" arguments:nil usingBlock:^(NSDictionary *row, BOOL *stop) {
+        XCTAssertNotNil(row[@"id"]);
+        rowCount++;
+    }];
+    XCTAssertEqual(rowCount, 1000);
+}
+
+- (void)testKeysetCursor
+{
+    [FCModel performTransaction:^BOOL{
+        for (int i = 1; i <= 25; i++) [SimplerModel executeUpdateQuery:@"INSERT INTO $T (id, title) VALUES (?, ?)", @(i), (i % 2 ? @"odd" : @"even")];
+        return YES;
+    }];
+
+    FCModelCursor *cursor = [[FCModelCursor alloc] initWithModelClass:SimplerModel.class where:nil arguments:nil orderedBy:@"title" ascending:YES pageSize:10];
+    NSArray *page1 = [cursor nextPage];
+    NSArray *page2 = [cursor nextPage];
+    NSArray *page3 = [cursor nextPage];
+    XCTAssertEqual(page1.count, 10);
+    XCTAssertEqual(page2.count, 10);
+    XCTAssertEqual(page3.count, 5);
+    XCTAssertEqual([cursor nextPage].count, 0);
+    XCTAssertEqualObjects(((SimplerModel *) page1.firstObject).title, @"even");
+    XCTAssertEqual(((SimplerModel *) page1.firstObject).id, 2);
+    XCTAssertEqual(((SimplerModel *) page3.lastObject).id, 25);
+
+    XCTAssertEqualObjects([cursor previousPage], page2);
+    XCTAssertEqualObjects([cursor previousPage], page1);
+    XCTAssertEqual([cursor previousPage].count, 0);
+
+    FCModelCursor *descending = [[FCModelCursor alloc] initWithModelClass:SimplerModel.class where:@"title = ?" arguments:@[ @"odd" ] orderedBy:nil ascending:NO pageSize:5];
+    XCTAssertEqualObjects([[descending nextPage] valueForKey:@"id"], (@[ @25, @23, @21, @19, @17 ]));
+    XCTAssertEqualObjects([[descending nextPage] valueForKey:@"id"], (@[ @15, @13, @11, @9, @7 ]));
+
+    // NULL sort values come first ascending and last descending, including at page edges
+    for (int i = 26; i <= 28; i++) [SimplerModel executeUpdateQuery:@"INSERT INTO $T (id, title) VALUES (?, NULL)", @(i)];
+    FCModelCursor *withNulls = [[FCModelCursor alloc] initWithModelClass:SimplerModel.class where:nil arguments:nil orderedBy:@"title" ascending:YES pageSize:2];
+    XCTAssertEqualObjects([[withNulls nextPage] valueForKey:@"id"], (@[ @26, @27 ]));
+    XCTAssertEqualObjects([[withNulls nextPage] valueForKey:@"id"], (@[ @28, @2 ]));
+    XCTAssertEqualObjects([[withNulls previousPage] valueForKey:@"id"], (@[ @26, @27 ]));
+
+    FCModelCursor *nullsLast = [[FCModelCursor alloc] initWithModelClass:SimplerModel.class where:nil arguments:nil orderedBy:@"title" ascending:NO pageSize:10];
+    NSMutableArray *ids = [NSMutableArray array];
+    for (NSArray *page = [nullsLast nextPage]; page.count; page = [nullsLast nextPage]) [ids addObjectsFromArray:[page valueForKey:@"id"]];
+    XCTAssertEqual(ids.count, 28);
+    XCTAssertEqualObjects([ids subarrayWithRange:NSMakeRange(25, 3)], (@[ @28, @27, @26 ]));
+}
+
+- (void)testOnlyFixedStatementsStayCached
+{
+    for (int i = 1; i <= 100; i++) [SimplerModel instancesWhere:[NSString stringWithFormat:@"id = %d", i] arguments:nil];
+    [SimplerModel instanceWithPrimaryKey:@1 createIfNonexistent:NO];
+
+    __block NSUInteger cachedStatementCount = 0;
+    [FCModel inDatabaseSync:^(FMDatabase *db) { cachedStatementCount = db.cachedStatements.count; }];
+    XCTAssertGreaterThan(cachedStatementCount, 0);
+    XCTAssertLessThan(cachedStatementCount, 100);
+}
+
+- (void)testBulkInsert
+{
+    __block int notifications = 0;
+    id observer = [NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:SimplerModel.class queue:nil usingBlock:^(NSNotification *n) {
+        notifications++;
+    }];
+
+    NSMutableArray *newInstances = [NSMutableArray array];
+    for (int i = 1; i <= 100; i++) {
+        SimplerModel *model = [SimplerModel instanceWithPrimaryKey:@(i)];
+        model.title = @"bulk";
+        [newInstances addObject:model];
+    }
+    XCTAssertTrue([SimplerModel insertInstances:newInstances]);
+    XCTAssertEqual(notifications, 1);
+    XCTAssertTrue(((SimplerModel *) newInstances.lastObject).existsInDatabase);
+    XCTAssertFalse(((SimplerModel *) newInstances.lastObject).hasUnsavedChanges);
+    XCTAssertEqual([SimplerModel numberOfInstancesWhere:@"title = 'bulk'"], 100);
+
+    NSArray *inserted = [SimplerModel insertInstancesWithFieldValues:@[ @{ @"title" : @"dict" }, @{ @"id" : @500, @"title" : @"dict" } ]];
+    XCTAssertEqual(inserted.count, 2);
+    XCTAssertEqual(notifications, 2);
+    XCTAssertEqual([SimplerModel instanceWithPrimaryKey:@500], inserted.lastObject);
+    XCTAssertEqual([SimplerModel numberOfInstancesWhere:@"title = 'dict'"], 2);
+
+    XCTAssertThrows([SimplerModel insertInstances:@[ [SimplerModel instanceWithPrimaryKey:@1] ]]);
+
+    SimplerModel *loaded = [SimplerModel instanceWithPrimaryKey:@600];
+    XCTAssertThrows([SimplerModel insertInstancesWithFieldValues:@[ @{ @"id" : @601, @"title" : @"dup" }, @{ @"id" : @600, @"title" : @"dup" } ]]);
+    XCTAssertEqual([SimplerModel numberOfInstancesWhere:@"title = 'dup'"], 0);
+    XCTAssertEqual([SimplerModel instanceWithPrimaryKey:@600], loaded);
+
+    // A supplied key that's only in the database fails the batch without closing the database
+    [SimplerModel executeUpdateQuery:@"INSERT INTO $T (id, title) VALUES (700, 'existing')"];
+    XCTAssertNil([SimplerModel insertInstancesWithFieldValues:@[ @{ @"id" : @699, @"title" : @"clash" }, @{ @"id" : @700, @"title" : @"clash" } ]]);
+    XCTAssertTrue(FCModel.databaseIsOpen);
+    XCTAssertEqual([SimplerModel numberOfInstancesWhere:@"title = 'clash'"], 0);
+    [NSNotificationCenter.defaultCenter removeObserver:observer];
+}
+
+- (void)testUpsert
+{
+    NSMutableArray *changeTypes = [NSMutableArray array];
+    id observer = [NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:SimplerModel.class queue:nil usingBlock:^(NSNotification *n) {
+        [changeTypes addObject:n.userInfo[FCModelChangeTypeKey]];
+    }];
+
+    XCTAssertTrue([SimplerModel upsertWithFieldValues:@{ @"id" : @1, @"title" : @"first" }]);
+    SimplerModel *loaded = [SimplerModel instanceWithPrimaryKey:@1];
+    XCTAssertEqualObjects(loaded.title, @"first");
+
+    XCTAssertTrue([SimplerModel upsertWithFieldValues:@{ @"id" : @1, @"title" : @"second" }]);
+    XCTAssertEqualObjects(loaded.title, @"second");
+    XCTAssertFalse(loaded.hasUnsavedChanges);
+    // Without a loaded instance to report, the insert is only listed in FCModelInsertedPrimaryKeyValuesKey
+    XCTAssertEqualObjects(changeTypes, (@[ @(FCModelChangeTypeUnspecified), @(FCModelChangeTypeUpdate) ]));
+
+    XCTAssertTrue([SimplerModel upsertWithFieldValueDictionaries:@[ @{ @"id" : @1, @"title" : @"third" }, @{ @"id" : @2, @"title" : @"new" } ]]);
+    XCTAssertEqualObjects(changeTypes.lastObject, @(FCModelChangeTypeUnspecified));
+    XCTAssertEqualObjects(loaded.title, @"third");
+    XCTAssertEqual([SimplerModel numberOfInstances], 2);
+
+    XCTAssertThrows([SimplerModel upsertWithFieldValues:@{ @"title" : @"no key" }]);
+    [NSNotificationCenter.defaultCenter removeObserver:observer];
+}
+
+- (void)testSequentialPrimaryKeyGeneration
+{
+    [SequentialKeyModel executeUpdateQuery:@"INSERT INTO $T (id, title) VALUES (41, 'existing')"];
+
+    SequentialKeyModel *first = [SequentialKeyModel new];
+    SequentialKeyModel *second = [SequentialKeyModel new];
+    XCTAssertEqual(first.id, 42);
+    XCTAssertEqual(second.id, 43);
+    XCTAssertTrue([first save:nil]);
+    XCTAssertEqual([SequentialKeyModel instanceWithPrimaryKey:@42 createIfNonexistent:NO], first);
+
+    // A row inserted behind the allocator's back makes the next key collide, so it's replaced at insert time
+    [SequentialKeyModel executeUpdateQuery:@"INSERT INTO $T (id, title) VALUES (44, 'external')"];
+    SequentialKeyModel *third = [SequentialKeyModel new];
+    XCTAssertEqual(third.id, 44);
+    XCTAssertTrue([third save:^{ third.title = @"third"; }]);
+    XCTAssertEqual(third.id, 45);
+    XCTAssertEqual([SequentialKeyModel instanceWithPrimaryKey:@45 createIfNonexistent:NO], third);
+}
+
+- (void)testBatchDelete
+{
+    NSMutableArray *instances = [NSMutableArray array];
+    for (int i = 1; i <= 20; i++) {
+        SimplerModel *model = [SimplerModel instanceWithPrimaryKey:@(i)];
+        model.title = @"doomed";
+        [instances addObject:model];
+    }
+    XCTAssertTrue([SimplerModel insertInstances:instances]);
+
+    __block int notifications = 0;
+    __block NSArray *deletedKeys = nil;
+    id observer = [NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:SimplerModel.class queue:nil usingBlock:^(NSNotification *n) {
+        notifications++;
+        XCTAssertEqualObjects(n.userInfo[FCModelChangeTypeKey], @(FCModelChangeTypeUnspecified));
+        deletedKeys = n.userInfo[FCModelDeletedPrimaryKeyValuesKey];
+    }];
+
+    [SimplerModel deleteInstances:[instances subarrayWithRange:NSMakeRange(0, 10)]];
+    XCTAssertEqual(notifications, 1);
+    XCTAssertEqual(deletedKeys.count, 10);
+    XCTAssertTrue(((SimplerModel *) instances.firstObject).isDeleted);
+    XCTAssertNil([SimplerModel instanceWithPrimaryKey:@1 createIfNonexistent:NO]);
+
+    [SimplerModel deleteInstancesWithPrimaryKeyValues:@[ @"11", @12, @999 ]];
+    XCTAssertEqual(notifications, 2);
+    XCTAssertTrue(((SimplerModel *) instances[10]).isDeleted);
+    XCTAssertEqual([SimplerModel numberOfInstances], 8);
+
+    [NSNotificationCenter.defaultCenter removeObserver:observer];
+}
+
+- (void)testPrimaryKeyLookupInKeyOrder
+{
+    NSMutableArray *fieldValues = [NSMutableArray array];
+    for (int i = 1; i <= 50; i++) [fieldValues addObject:@{ @"id" : @(i), @"title" : (i % 2 ? @"odd" : @"even") }];
+    XCTAssertNotNil([SimplerModel insertInstancesWithFieldValues:fieldValues]);
+
+    NSArray *found = [SimplerModel instancesWherePrimaryKeyValueIn:@[ @30, @"7", @999, @12, @30 ] andWhere:nil arguments:nil options:FCModelPrimaryKeyLookupOptionPreserveKeyOrder];
+    XCTAssertEqualObjects([found valueForKey:@"id"], (@[ @30, @7, @12 ]));
+
+    found = [SimplerModel instancesWherePrimaryKeyValueIn:@[ @9, @8, @7, @6 ] andWhere:@"title = ?" arguments:@[ @"odd" ] options:FCModelPrimaryKeyLookupOptionPreserveKeyOrder];
+    XCTAssertEqualObjects([found valueForKey:@"id"], (@[ @9, @7 ]));
+    
+    XCTAssertEqual([SimplerModel numberOfInstancesWherePrimaryKeyValueIn:@[ @1, @2, @3 ] andWhere:@"title = 'even'" arguments:nil], 1);
+}
+
+- (void)testExecuteUpdateReloadsOnlyAffectedInstances
+{
+    NSArray *instances = [SimplerModel insertInstancesWithFieldValues:@[ @{ @"id" : @1, @"title" : @"a" }, @{ @"id" : @2, @"title" : @"b" } ]];
+    SimplerModel *affected = instances[0], *unaffected = instances[1];
+    unaffected.title = @"unsaved";
+
+    [SimplerModel executeUpdateQuery:@"UPDATE $T SET title = 'changed' WHERE id = 1"];
+    XCTAssertEqualObjects(affected.title, @"changed");
+    XCTAssertFalse(affected.hasUnsavedChanges);
+    XCTAssertEqualObjects(unaffected.title, @"unsaved"); // not reloaded, so the unsaved change survives
+    XCTAssertTrue(unaffected.hasUnsavedChanges);
+}
+
+- (void)testUpdateHookCoalescesExternalWrites
+{
+    __block int notifications = 0;
+    __block NSSet *rowIDs = nil;
+    id observer = [NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:SimplerModel.class queue:nil usingBlock:^(NSNotification *n) {
+        notifications++;
+        rowIDs = n.userInfo[FCModelChangedRowIDsKey];
+    }];
+
+    [SimplerModel inDatabaseSync:^(FMDatabase *db) {
+        for (int i = 1; i <= 100; i++) [db executeUpdate:@"INSERT INTO SimplerModel (id, title) VALUES (?, 'raw')", @(i)];
+    }];
+    XCTAssertEqual(notifications, 0);
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    
+    XCTAssertEqual(notifications, 1);
+    XCTAssertEqual(rowIDs.count, 100);
+    XCTAssertTrue([rowIDs containsObject:@42]);
+    [NSNotificationCenter.defaultCenter removeObserver:observer];
+}
+
+- (void)testPrimaryKeysInCoalescedNotifications
+{
+    [SimplerModel insertInstancesWithFieldValues:@[ @{ @"id" : @1, @"title" : @"a" }, @{ @"id" : @2, @"title" : @"b" } ]];
+
+    __block NSDictionary *userInfo = nil;
+    id observer = [NSNotificationCenter.defaultCenter addObserverForName:FCModelChangeNotification object:SimplerModel.class queue:nil usingBlock:^(NSNotification *n) {
+        userInfo = n.userInfo;
+    }];
+
+    [SimplerModel performTransaction:^BOOL{
+        [[SimplerModel instanceWithPrimaryKey:@1] save:^{ [SimplerModel instanceWithPrimaryKey:@1].title = @"changed"; }];
+        [[SimplerModel instanceWithPrimaryKey:@2] delete];
+        SimplerModel *inserted = [SimplerModel instanceWithPrimaryKey:@3];
+        [inserted save:^{ inserted.title = @"c"; }];
+        [SimplerModel executeUpdateQuery:@"UPDATE $T SET title = 'd' WHERE id = 3"];
+        return YES;
+    }];
+    
+    XCTAssertEqualObjects(userInfo[FCModelUpdatedPrimaryKeyValuesKey], [NSSet setWithObject:@1]);
+    XCTAssertEqualObjects(userInfo[FCModelDeletedPrimaryKeyValuesKey], [NSSet setWithObject:@2]);
+    XCTAssertEqualObjects(userInfo[FCModelInsertedPrimaryKeyValuesKey], [NSSet setWithObject:@3]);
+    [NSNotificationCenter.defaultCenter removeObserver:observer];
+}
+
+
+- (void)testFieldChangeObserversOnlyReceiveMatchingFields
+{
+    [SimpleModel addObserver:self selector:@selector(simpleModelNameChanged:) forChangedFields:[NSSet setWithObject:@"name"]];
+    [SimpleModel addObserver:self selector:@selector(simpleModelDateChanged:) forChangedFields:[NSSet setWithObjects:@"date", @"name", nil]];
+
+    SimpleModel *entity = [SimpleModel instanceWithPrimaryKey:@"a"];
+    [entity save:^{ entity.date = [NSDate date]; }];
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(self.nameChangeCount, 0);
+    XCTAssertEqual(self.dateChangeCount, 1);
+
+    // Both observers watch "name", but each is only called once for a change to both fields
+    [entity save:^{ entity.name = @"changed"; entity.date = [NSDate dateWithTimeIntervalSince1970:0]; }];
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(self.nameChangeCount, 1);
+    XCTAssertEqual(self.dateChangeCount, 2);
+
+    [SimpleModel removeObserverForFieldChanges:self];
+    [entity save:^{ entity.name = @"changed again"; }];
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(self.nameChangeCount, 1);
+}
+
+- (void)testInstanceObserversFollowReplacedPrimaryKey
+{
+    SequentialKeyModel *first = [SequentialKeyModel new];
+    XCTAssertTrue([first save:nil]);
+    [SequentialKeyModel executeUpdateQuery:@"INSERT INTO $T (id, title) VALUES (?, 'external')", @(first.id + 1)];
+
+    SequentialKeyModel *observed = [SequentialKeyModel new];
+    XCTAssertEqual(observed.id, first.id + 1);
+    [observed addObserver:self selector:@selector(simpleModelNameChanged:) forChangedFields:nil];
+    XCTAssertTrue([observed save:^{ observed.title = @"saved"; }]);
+    XCTAssertEqual(observed.id, first.id + 2);
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(self.nameChangeCount, 1);
+
+    [SequentialKeyModel executeUpdateQuery:@"UPDATE $T SET title = 'changed' WHERE id = ?", @(observed.id)];
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(self.nameChangeCount, 2);
+    [observed removeObserverForFieldChanges:self];
+}
+
+- (void)testInstanceObserversOnlyReceiveTheirRow
+{
+    [SimplerModel insertInstancesWithFieldValues:@[ @{ @"id" : @1, @"title" : @"a" }, @{ @"id" : @2, @"title" : @"b" } ]];
+    SimplerModel *observed = [SimplerModel instanceWithPrimaryKey:@1];
+    [observed addObserver:self selector:@selector(simpleModelNameChanged:) forChangedFields:nil];
+
+    [[SimplerModel instanceWithPrimaryKey:@2] save:^{ [SimplerModel instanceWithPrimaryKey:@2].title = @"changed"; }];
+    [SimplerModel executeUpdateQuery:@"UPDATE $T SET title = 'changed' WHERE id = 2"];
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(self.nameChangeCount, 0);
+
+    [SimplerModel executeUpdateQuery:@"UPDATE $T SET title = 'changed' WHERE id = 1"];
+    [SimplerModel inDatabaseSync:^(FMDatabase *db) { [db executeUpdate:@"UPDATE SimplerModel SET title = 'raw' WHERE id = 1"]; }];
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(self.nameChangeCount, 2);
+
+    [observed removeObserverForFieldChanges:self];
+    [observed save:^{ observed.title = @"changed again"; }];
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(self.nameChangeCount, 2);
+}
+
+- (void)testCachedQueryIgnoresUpdatesToUnreadFields
+{
+    SimpleModel *entity = [SimpleModel instanceWithPrimaryKey:@"a"];
+    [entity save:^{ entity.name = @"Alice"; }];
+
+    NSArray *cached = [SimpleModel cachedInstancesWhere:@"name = ?" arguments:@[ @"Alice" ]];
+    XCTAssertEqual(cached.count, 1);
+
+    [entity save:^{ entity.date = [NSDate date]; }];
+    XCTAssertTrue(cached == [SimpleModel cachedInstancesWhere:@"name = ?" arguments:@[ @"Alice" ]]);
+
+    // Raw SQL doesn't say which fields it changed, so it always invalidates
+    [SimpleModel executeUpdateQuery:@"UPDATE $T SET mixedcase = 5 WHERE uniqueID = 'a'"];
+    XCTAssertFalse(cached == [SimpleModel cachedInstancesWhere:@"name = ?" arguments:@[ @"Alice" ]]);
+
+    [entity save:^{ entity.name = @"Bob"; }];
+    XCTAssertEqual([SimpleModel cachedInstancesWhere:@"name = ?" arguments:@[ @"Alice" ]].count, 0);
+
+    SimpleModel *other = [SimpleModel instanceWithPrimaryKey:@"b"];
+    [other save:^{ other.name = @"Alice"; }];
+    XCTAssertEqual([SimpleModel cachedInstancesWhere:@"name = ?" arguments:@[ @"Alice" ]].count, 1);
+}
+
+- (void)testCachedQueryUpdatesIncrementally
+{
+    for (NSString *key in @[ @"a", @"b", @"c" ]) {
+        SimpleModel *entity = [SimpleModel instanceWithPrimaryKey:key];
+        [entity save:^{ entity.name = key; entity.mixedcase = 1; }];
+    }
+
+    NSArray *cached = [SimpleModel cachedInstancesWhere:@"mixedcase = ? ORDER BY name DESC" arguments:@[ @1 ]];
+    XCTAssertEqualObjects([cached valueForKey:@"uniqueID"], (@[ @"c", @"b", @"a" ]));
+
+    SimpleModel *inserted = [SimpleModel instanceWithPrimaryKey:@"bb"];
+    [inserted save:^{ inserted.name = @"bb"; inserted.mixedcase = 1; }];
+    SimpleModel *excluded = [SimpleModel instanceWithPrimaryKey:@"c"];
+    [excluded save:^{ excluded.mixedcase = 2; }];
+    [[SimpleModel instanceWithPrimaryKey:@"a"] delete];
+
+    cached = [SimpleModel cachedInstancesWhere:@"mixedcase = ? ORDER BY name DESC" arguments:@[ @1 ]];
+    XCTAssertEqualObjects([cached valueForKey:@"uniqueID"], (@[ @"bb", @"b" ]));
+    XCTAssertEqualObjects(cached, [SimpleModel instancesWhere:@"mixedcase = ? ORDER BY name DESC" arguments:@[ @1 ]]);
+
+    // Rows are placed by their saved values, as SQLite orders them, not by unsaved changes
+    SimpleModel *unsaved = [SimpleModel instanceWithPrimaryKey:@"b"];
+    unsaved.name = @"zz";
+    SimpleModel *between = [SimpleModel instanceWithPrimaryKey:@"ba"];
+    [between save:^{ between.name = @"ba"; between.mixedcase = 1; }];
+    cached = [SimpleModel cachedInstancesWhere:@"mixedcase = ? ORDER BY name DESC" arguments:@[ @1 ]];
+    XCTAssertEqualObjects([cached valueForKey:@"uniqueID"], (@[ @"bb", @"ba", @"b" ]));
+    [unsaved revertUnsavedChanges];
+}
+
+- (void)testCachedObjectCostLimitEvictsLeastRecentlyUsed
+{
+    [FCModelCachedObject clearCache];
+    [FCModelCachedObject setCacheCostLimit:10];
+
+    __block int generatorCalls = 0;
+    id (^generator)(void) = ^id{ generatorCalls++; return @[ @1, @2, @3, @4 ]; };
+    [SimpleModel cachedObjectWithIdentifier:@"a" ignoreFieldsForInvalidation:nil generator:generator];
+    [SimpleModel cachedObjectWithIdentifier:@"b" ignoreFieldsForInvalidation:nil generator:generator];
+    [SimpleModel cachedObjectWithIdentifier:@"a" ignoreFieldsForInvalidation:nil generator:generator];
+    XCTAssertEqual(FCModelCachedObject.cacheTotalCost, 8);
+
+    // "b" is now the least recently used, so it's evicted to make room for "c"
+    [SimpleModel cachedObjectWithIdentifier:@"c" ignoreFieldsForInvalidation:nil generator:generator];
+    XCTAssertEqual(generatorCalls, 3);
+    XCTAssertEqual(FCModelCachedObject.cacheTotalCost, 8);
+    [SimpleModel cachedObjectWithIdentifier:@"a" ignoreFieldsForInvalidation:nil generator:generator];
+    XCTAssertEqual(generatorCalls, 3);
+    [SimpleModel cachedObjectWithIdentifier:@"b" ignoreFieldsForInvalidation:nil generator:generator];
+    XCTAssertEqual(generatorCalls, 4);
+
+    [SimpleModel cachedObjectWithIdentifier:@"big" ignoreFieldsForInvalidation:nil cost:10 generator:^id{ return @"big"; }];
+    XCTAssertEqual(FCModelCachedObject.cacheTotalCost, 10);
+    [FCModelCachedObject trimCacheToCost:0];
+    XCTAssertEqual(FCModelCachedObject.cacheTotalCost, 0);
+
+    [FCModelCachedObject setCacheCostLimit:0];
+}
+
+- (void)testCachedObjectIdentifiersMatchByValue
+{
+    __block int generatorCalls = 0;
+    for (int i = 0; i < 1000; i++) {
+        NSMutableArray *identifier = [NSMutableArray arrayWithObjects:@"query", @[ @(i % 10), [NSString stringWithFormat:@"%d", i % 10] ], nil];
+        NSNumber *value = [SimpleModel cachedObjectWithIdentifier:identifier ignoreFieldsForInvalidation:nil generator:^id{ generatorCalls++; return @(i % 10); }];
+        XCTAssertEqualObjects(value, @(i % 10));
+    }
+    XCTAssertEqual(generatorCalls, 10);
+}
+
+- (void)testConcurrentCachedObjectMissesShareOneGeneration
+{
+    __block int generatorCalls = 0;
+    dispatch_group_t group = dispatch_group_create();
+    for (int i = 0; i < 8; i++) {
+        dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            id value = [SimpleModel cachedObjectWithIdentifier:@"shared" ignoreFieldsForInvalidation:nil generator:^id{
+                @synchronized (self) { generatorCalls++; }
+                [NSThread sleepForTimeInterval:0.1];
+                return @"value";
+            }];
+            XCTAssertEqualObjects(value, @"value");
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    XCTAssertEqual(generatorCalls, 1);
+}
+
+- (void)testCachedObjectGeneratorReadingItsOwnValue
+{
+    __block int generatorCalls = 0;
+    __block __weak FCModelCachedObject *weakCached = nil;
+    FCModelCachedObject *cached = [FCModelCachedObject objectWithModelClass:SimpleModel.class cacheIdentifier:@"reentrant" ignoreFieldsForInvalidation:nil generator:^id{
+        return ++generatorCalls == 1 ? [NSString stringWithFormat:@"outer %@", weakCached.value] : @"inner";
+    }];
+    weakCached = cached;
+
+    // Off the database queue, the nested read must not wait for the generation it's running inside of
+    XCTestExpectation *generated = [self expectationWithDescription:@"reentrant generation"];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+        XCTAssertEqualObjects(cached.value, @"outer inner");
+        [generated fulfill];
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(generatorCalls, 2);
+}
+
+- (void)simpleModelNameChanged:(NSNotification *)n { self.nameChangeCount++; }
+- (void)simpleModelDateChanged:(NSNotification *)n { self.dateChangeCount++; }
+
 
 #pragma mark - Helper methods
 
-- (void)openDatabase
+- (void)openDatabase { [self openDatabaseWithOptions:FCModelDatabaseOptionsNone]; }
+
+- (void)openDatabaseWithOptions:(FCModelDatabaseOptions)options
 {
     [FCModel openDatabaseAtPath:[self dbPath] withDatabaseInitializer:NULL schemaBuilder:^(FMDatabase *db, int *schemaVersion) {
         [db setCrashOnErrors:YES];
@@ -404,11 +1162,24 @@
                 @");"
             ]) failedAt(2);
 
+            if (! [db executeUpdate:
+                @"CREATE TABLE InitOverrideModel ("
+                @"    id    INTEGER PRIMARY KEY,"
+                @"    title TEXT"
+                @");"
+            ]) failedAt(3);
+
+            if (! [db executeUpdate:
+                @"CREATE TABLE SequentialKeyModel ("
+                @"    id    INTEGER PRIMARY KEY,"
+                @"    title TEXT"
+                @");"
+            ]) failedAt(4);
 
             *schemaVersion = 1;
         }
         [db commit];
-    }];
+    } moduleName:nil options:options];
 }
 
 - (NSString *)dbPath
@@ -0,0 +1,15 @@
+//
+//  InitOverrideModel.h
+//  FCModelTest
+//
+
+#import "FCModel.h"
+
+// Overrides FCModel's designated initializer, as some subclasses do to set up state from a row's values
+@interface InitOverrideModel : FCModel
+
+@property (nonatomic) int64_t id;
+@property (nonatomic, copy) NSString *title;
+@property (nonatomic, readonly) NSDictionary *initialFieldValues;
+
+@end
@@ -0,0 +1,22 @@
+//
+//  InitOverrideModel.m
+//  FCModelTest
+//
+
+#import "InitOverrideModel.h"
+
+@interface FCModel (DesignatedInitializer)
+- (instancetype)initWithFieldValues:(NSDictionary *)fieldValues existsInDatabaseAlready:(BOOL)existsInDB;
+@end
+
+@implementation InitOverrideModel
+
+- (instancetype)initWithFieldValues:(NSDictionary *)fieldValues existsInDatabaseAlready:(BOOL)existsInDB
+{
+    if ( (self = [super initWithFieldValues:fieldValues existsInDatabaseAlready:existsInDB]) ) {
+        _initialFieldValues = [fieldValues copy];
+    }
+    return self;
+}
+
+@end
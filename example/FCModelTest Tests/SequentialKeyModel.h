@@ -0,0 +1,14 @@
+//
+//  SequentialKeyModel.h
+//  FCModelTest
+//
+
+#import "FCModel.h"
+
+// Generates its primary keys with FCModelPrimaryKeyGenerationSequential
+@interface SequentialKeyModel : FCModel
+
+@property (nonatomic) int64_t id;
+@property (nonatomic, copy) NSString *title;
+
+@end
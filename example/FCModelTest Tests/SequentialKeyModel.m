@@ -0,0 +1,12 @@
+//
+//  SequentialKeyModel.m
+//  FCModelTest
+//
+
+#import "SequentialKeyModel.h"
+
+@implementation SequentialKeyModel
+
++ (FCModelPrimaryKeyGeneration)primaryKeyGeneration { return FCModelPrimaryKeyGenerationSequential; }
+
+@end
@@ -10,4 +10,6 @@
 
 @implementation SimpleModel
 
++ (BOOL)tracksChangesWithSetters { return YES; }
+
 @end
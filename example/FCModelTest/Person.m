@@ -10,6 +10,7 @@
 
 @implementation Person
 
++ (BOOL)tracksChangesWithSetters { return YES; }
 
 - (BOOL)save:(void (^)())modificiationsBlock
 {